@@ -172,6 +172,7 @@ function(cksdk_executable name target_exe target_map)
 		"${SRC_DIR}/OS/ExScreen_Font.h"
 		"${SRC_DIR}/OS/TTY.cpp"
 		"${SRC_DIR}/OS/Mem.cpp"
+		"${SRC_DIR}/OS/Mem.s"
 		"${SRC_DIR}/OS/Timer.cpp"
 
 		"${INC_DIR}/OS.h"
@@ -189,6 +190,9 @@ function(cksdk_executable name target_exe target_map)
 
 		# GPU
 		"${SRC_DIR}/GPU/GPU.cpp"
+		"${SRC_DIR}/GPU/SpriteBatch.cpp"
+		"${SRC_DIR}/GPU/Line.cpp"
+		"${SRC_DIR}/GPU/VRAM.cpp"
 
 		"${INC_DIR}/GPU.h"
 		"${INC_DIR}/GTE.h"
@@ -214,6 +218,7 @@ function(cksdk_executable name target_exe target_map)
 
 		# Util
 		"${INC_DIR}/Util/Fixed.h"
+		"${INC_DIR}/Util/Pool.h"
 		"${INC_DIR}/Util/Queue.h"
 
 		# STL
@@ -42,3 +42,13 @@
 #else
 #define KEEP __attribute__((used))
 #endif
+
+// Scratchpad section
+/// @brief Scratchpad section
+/// @details This places a variable in the 1 KiB scratchpad. The scratchpad can't be loaded into, so variables are zeroed like BSS before constructors run and can't have initial data.
+/// @note Only executables have a scratchpad section, DLLs can't use this.
+#ifdef __INTELLISENSE__
+#define SCRATCHPAD
+#else
+#define SCRATCHPAD __attribute__((section(".scratchpad")))
+#endif
@@ -267,6 +267,8 @@ namespace CKSDK
 			GP0_FlushCache = GP0_Misc | 1,
 			/// @brief Fill a rectangle directly to VRAM
 			GP0_FillRect = GP0_Misc | 2,
+			/// @brief Raise the GPU IRQ once the commands before it are done
+			GP0_IRQ = GP0_Misc | 0x1F,
 		};
 
 		// GP0_Poly
@@ -479,6 +481,70 @@ namespace CKSDK
 		template <GP0_RectSize Size = GP0_RectSize::Variable>
 		using SpritePrim = RectPrim<true, Size>;
 
+		// GP0_Line
+		enum GP0_LineCmds
+		{
+			/// @brief Each vertex has a color
+			GP0_Line_Grad = (1 << 4),
+			/// @brief Line is a poly-line
+			GP0_Line_Poly = (1 << 3),
+			/// @brief Semi-transparency is enabled
+			GP0_Line_Semi = (1 << 1),
+		};
+
+		/// @brief Word that ends a poly-line
+		static constexpr Word GP0_LineTerminator = 0x55555555;
+
+		/// @brief Line primitive template structure
+		/// @tparam Grad `true` if each vertex has a color
+		/// @tparam Semi `true` if semi-transparent
+		///
+		/// @details The structure will contain v0 and v1, each with \link ScreenCoord xy\endlink, as well as \link Color c\endlink (if `Grad` is `true`).
+		/// @details The color of the line, if `Grad` is `false`, is set by `v0.c`.
+		template<bool Grad, bool Semi = false>
+		struct LinePrim
+		{
+			/// @brief First vertex
+			PolyVertex<true, false> v0;
+			/// @brief Second vertex
+			PolyVertex<Grad, false> v1;
+
+			LinePrim()
+			{
+				v0.c.w = (GP0_Line |
+					(Grad ? GP0_Line_Grad : 0) |
+					(Semi ? GP0_Line_Semi : 0)) << 24;
+			}
+		};
+
+		/// @brief Poly-line primitive template structure
+		/// @tparam N Number of vertices
+		/// @tparam Grad `true` if each vertex has a color
+		/// @tparam Semi `true` if semi-transparent
+		///
+		/// @details The structure will contain v0, then the vertices after it in v, and ends with the terminator word.
+		/// @details The color of the poly-line, if `Grad` is `false`, is set by `v0.c`.
+		template<size_t N, bool Grad = false, bool Semi = false>
+		struct PolyLinePrim
+		{
+			static_assert(N >= 2, "Poly-line needs at least two vertices");
+
+			/// @brief First vertex
+			PolyVertex<true, false> v0;
+			/// @brief Vertices after the first
+			PolyVertex<Grad, false> v[N - 1];
+			/// @brief GP0_LineTerminator
+			Word term;
+
+			PolyLinePrim()
+			{
+				v0.c.w = (GP0_Line | GP0_Line_Poly |
+					(Grad ? GP0_Line_Grad : 0) |
+					(Semi ? GP0_Line_Semi : 0)) << 24;
+				term = GP0_LineTerminator;
+			}
+		};
+
 		// GP0_Env
 		enum GP0_EnvCmds
 		{
@@ -548,6 +614,8 @@ namespace CKSDK
 			GP1_Reset = 0x00,
 			/// @brief Flush the GPU command buffer
 			GP1_Flush = 0x01,
+			/// @brief Acknowledge the GPU IRQ
+			GP1_AckIRQ = 0x02,
 			/// @brief Mask or unmask the screen
 			GP1_DisplayEnable = 0x03,
 			/// @brief Set the DMA direction
@@ -608,9 +676,12 @@ namespace CKSDK
 			/// @param y The top of the area in VRAM
 			/// @param w The width of the area in VRAM
 			/// @param h The height of the area in VRAM
+			/// @note The spans and mode are set up by SetScreen
 			DisplayEnvironment(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
 			{
-
+				(void)w;
+				(void)h;
+				vram = (GP1_DisplayVRAM << 24) | ((x) << 0) | ((y) << 10);
 			}
 		};
 
@@ -657,41 +728,178 @@ namespace CKSDK
 		**/
 
 		// GPU buffers
+		/// @brief Ordering table layer index
+		typedef unsigned Layer;
+
+		/// @brief Maximum number of ordering table layers
+		static constexpr Layer LAYER_MAX = 4;
+		/// @brief Returned by FindLayer if no layer has the given name
+		static constexpr Layer LAYER_NONE = ~0U;
+
+		/// @brief Ordering table layer configuration
+		struct LayerConfig
+		{
+			/// @brief Layer name, may be null
+			const char *name;
+			/// @brief Size of the layer's ordering table in entries
+			size_t ot_size;
+		};
+
 		/// @brief GPU buffer
 		struct Buffer
 		{
 			// Screen
 			/// @brief Draw environment
 			DrawEnvironment draw_environment;
-			/// @brief Display environment (displays the other buffer)
+			/// @brief Display environment (displays the previous buffer)
 			DisplayEnvironment display_environment;
 
 			// Buffers
 			/// @brief Buffer pointer
 			Word *buffer;
-			/// @brief Ordering table size
+			/// @brief Ordering table size of layer 0
 			size_t ot_size;
+			/// @brief Buffer end
+			Word *buffer_end;
 			/// @brief Primitive buffer pointer
 			Word *prip;
+			/// @brief Primitive buffer end
+			Word *prie;
+
+			/// @brief Overflow page pointer
+			Word *overflow;
+			/// @brief Overflow page end
+			Word *overflow_end;
+			/// @brief Primitive buffer pointer when the overflow page was entered, null if it hasn't been
+			Word *spill;
+			/// @brief Number of packets allocated this frame
+			size_t packets;
+
+			// Layers
+			/// @brief Number of ordering table layers
+			Layer layer_count;
+			/// @brief Bit mask of layers that have had packets linked this frame
+			uint32_t layer_used;
+			/// @brief Ordering table of each layer, beginning with its terminator
+			Word *layer_ot[LAYER_MAX];
+			/// @brief Ordering table size of each layer
+			size_t layer_size[LAYER_MAX];
 
 			/// @brief Gets ordering table tag at index
+			/// @param layer Layer of tag
+			/// @param i Index of tag
+			/// @return Tag at index
+			Tag &GetOT(Layer layer, size_t i)
+			{ return *((Tag*)(&layer_ot[layer][1 + i])); }
+
+			/// @brief Gets ordering table tag at index of layer 0
 			/// @param i Index of tag
 			/// @return Tag at index
 			Tag &GetOT(size_t i)
-			{ return *((Tag*)(&buffer[1 + i])); }
+			{ return GetOT(0, i); }
+
+			/// @brief Gets the start of the primitive buffer, after the ordering tables
+			/// @return Primitive buffer start
+			Word *Packets()
+			{ return (Word*)(&GetOT(layer_count - 1, layer_size[layer_count - 1])); }
+
+			/// @brief Gets number of words used by packets
+			/// @return Words used by packets, including those in the overflow page
+			size_t Used()
+			{
+				Word *start = Packets();
+				if (spill != nullptr)
+					return (spill - start) + (prip - overflow);
+				return prip - start;
+			}
 
 			/// @brief Initializes primitive buffer and ordering table
+			/// @details This waits for the ordering tables to be cleared, Flip clears them asynchronously instead
 			void Init()
 			{
 				// Set primitive pointer
-				prip = (Word*)(&GetOT(ot_size));
+				prip = Packets();
+				prie = buffer_end;
+				spill = nullptr;
+				packets = 0;
 
 				// Initialize ordering tables
-				OS::DmaCtrl(OS::DMA::OTC).madr = uint32_t(&GetOT(ot_size - 1));
-				OS::DmaCtrl(OS::DMA::OTC).bcr  = (ot_size + 1) & 0xFFFF;
-				OS::DmaCtrl(OS::DMA::OTC).chcr = 0x11000002;
-				while ((OS::DmaCtrl(OS::DMA::OTC).chcr & (1 << 24)) != 0);
+				// Each layer is cleared separately, so small layers don't pay for big ones
+				for (Layer i = 0; i < layer_count; i++)
+				{
+					OS::DmaCtrl(OS::DMA::OTC).madr = uint32_t(&GetOT(i, layer_size[i] - 1));
+					OS::DmaCtrl(OS::DMA::OTC).bcr  = (layer_size[i] + 1) & 0xFFFF;
+					OS::DmaCtrl(OS::DMA::OTC).chcr = 0x11000002;
+					while ((OS::DmaCtrl(OS::DMA::OTC).chcr & (1 << 24)) != 0);
+				}
+				layer_used = 0;
 			}
+
+			/// @brief Links the non-empty layers back to back
+			/// @return Tag to start the ordering table DMA from
+			/// @details Layers are drawn in order, so layer 0 is drawn first
+			Tag &Link()
+			{
+				// Link from the last layer backwards, so each layer's terminator points to the next layer drawn
+				Tag *next = nullptr;
+				for (Layer i = layer_count; i-- != 0;)
+				{
+					if ((layer_used & (1U << i)) == 0)
+						continue;
+					if (next != nullptr)
+						new(layer_ot[i]) Tag(next, 0);
+					next = &GetOT(i, layer_size[i] - 1);
+				}
+
+				// If everything is empty, start from a terminator
+				if (next == nullptr)
+					return *((Tag*)layer_ot[0]);
+				return *next;
+			}
+		};
+
+		/// @brief Maximum number of GPU buffers
+		static constexpr size_t BUFFER_MAX = 3;
+
+		/// @brief GPU buffer statistics
+		/// @details All sizes are in words
+		struct BufferStats
+		{
+			/// @brief Packet words used by the last flipped frame
+			size_t used;
+			/// @brief Highest packet words used by a frame since SetBuffer or ResetBufferPeak was called
+			size_t peak;
+			/// @brief Packet words available in each buffer, excluding the ordering table
+			size_t size;
+			/// @brief Words available in each buffer's overflow page
+			size_t overflow_size;
+			/// @brief Number of frames that spilled into their overflow page
+			uint32_t overflows;
+		};
+
+		/// @brief Number of frames kept by the frame profiler
+		static constexpr size_t FRAME_STATS_MAX = 32;
+
+		/// @brief Frame profiler record
+		/// @details Times are in scanlines, counted by root counter 1
+		struct FrameStats
+		{
+			/// @brief Time from the last Flip returning to this one being called, building the frame
+			uint16_t cpu;
+			/// @brief Time spent in Flip
+			uint16_t flip;
+			/// @brief Time spent waiting in QueueSync, VBlankSync, and Flip for a free buffer
+			uint16_t wait;
+			/// @brief Time from Flip being called to the GPU starting the frame's ordering table
+			uint16_t gpu_start;
+			/// @brief Time the GPU spent reading the frame's ordering table, 0 if it hasn't finished yet
+			uint16_t gpu;
+			/// @brief Vblanks missed before this frame was flipped
+			uint16_t dropped;
+			/// @brief Packets allocated
+			uint32_t packets;
+			/// @brief Packet words used
+			uint32_t words;
 		};
 
 		/// @brief Current GPU buffer
@@ -707,10 +915,33 @@ namespace CKSDK
 		/// @param buffer Buffer to set
 		/// @param size Size of buffer in words
 		/// @param ot_size Size of ordering table in entries
-		/// @details This splits the given buffer into two for double buffering
+		/// @param count Number of buffers, from 2 to BUFFER_MAX
+		/// @details This splits the given buffer into count buffers, two for double buffering or three for triple buffering
 		/// @details The ordering table is placed at the beginning of each buffer
 		/// @details ot_size represents the addressable size of the ordering table, the terminator is added automatically
-		void SetBuffer(Word *buffer, size_t size, size_t ot_size);
+		/// @details Triple buffering lets the CPU build a frame while the GPU draws one and another waits for vblank, which is only useful in FlipMode_Async
+		/// @details This sets up a single layer
+		void SetBuffer(Word *buffer, size_t size, size_t ot_size, size_t count = 2);
+
+		/// @brief Set GPU buffer with ordering table layers
+		/// @param buffer Buffer to set
+		/// @param size Size of buffer in words
+		/// @param layers Layer configurations, in the order they're drawn
+		/// @param layer_count Number of layers, from 1 to LAYER_MAX
+		/// @param count Number of buffers, from 2 to BUFFER_MAX
+		/// @details Each layer has its own ordering table, so a small unsorted HUD layer doesn't share the clear of a big depth-sorted world layer
+		/// @details At Flip, layers that had packets linked with AllocPacket are linked back to back, and empty ones are skipped
+		void SetBuffer(Word *buffer, size_t size, const LayerConfig *layers, Layer layer_count, size_t count = 2);
+
+		/// @brief Waits for the current buffer's ordering tables to be cleared
+		/// @details Flip starts clearing the next buffer's ordering tables with the OTC DMA and returns without waiting. AllocPacket waits for it on its first call, so this is only needed when accessing the ordering tables directly with GetOT.
+		/// @note IRQs must be enabled, as the clear is advanced by the OTC DMA IRQ
+		void OTSync();
+
+		/// @brief Find a layer by name
+		/// @param name Layer name
+		/// @return Layer, or LAYER_NONE if no layer has the given name
+		Layer FindLayer(const char *name);
 
 		/// @brief Sets GPU framebuffers
 		/// @param w Width of framebuffers
@@ -724,12 +955,84 @@ namespace CKSDK
 		/// @details Valid widths are 256, 320, 368, 512, and 640
 		/// @details If height exceeds 256, the GPU will be set to interlaced mode
 		/// @details Changes will apply on the next call to Flip()
+		/// @details Buffers alternate between the two framebuffers, so this aborts if SetBuffer was given more than two buffers. Use the other overload for triple buffering.
 		void SetScreen(uint32_t w, uint32_t h, uint32_t ox, uint32_t oy, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
 
+		/// @brief Sets GPU framebuffers
+		/// @param w Width of framebuffers
+		/// @param h Height of framebuffers
+		/// @param ox X draw offset
+		/// @param oy Y draw offset
+		/// @param framebuffers Coordinates of each buffer's framebuffer in VRAM, one per buffer set by SetBuffer
+		/// @details Valid widths are 256, 320, 368, 512, and 640
+		/// @details If height exceeds 256, the GPU will be set to interlaced mode
+		/// @details Changes will apply on the next call to Flip()
+		/// @details Waits for the queue to empty and, with FlipMode_Async, for frames in flight to be shown
+		void SetScreen(uint32_t w, uint32_t h, uint32_t ox, uint32_t oy, const ScreenCoord *framebuffers);
+
+		/// @brief Gets the framebuffer areas set by SetScreen
+		/// @param rects Rects to fill, at least BUFFER_MAX
+		/// @return Number of framebuffers
+		size_t GetFramebuffers(Rect *rects);
+
+		/// @brief Set GPU overflow buffer
+		/// @param buffer Buffer to set
+		/// @param size Size of buffer in words
+		/// @details This splits the given buffer into an overflow page for each GPU buffer
+		/// @details When a packet doesn't fit in a buffer, packets for the rest of the frame are allocated from its overflow page instead. Packets are linked through their tags, so they can live anywhere in RAM.
+		/// @details Passing a null buffer disables the overflow pages
+		void SetOverflowBuffer(Word *buffer, size_t size);
+
+		/// @brief Get GPU buffer statistics
+		/// @param stats BufferStats to fill
+		/// @details Use this to size the buffers passed to SetBuffer and SetOverflowBuffer from real frames
+		void GetBufferStats(BufferStats *stats);
+
+		/// @brief Reset the peak and overflow count of the GPU buffer statistics
+		void ResetBufferPeak();
+
+		/// @brief Get a frame profiler record
+		/// @param ago Number of frames before the last flipped frame, less than FRAME_STATS_MAX
+		/// @return Record of the frame
+		/// @details The ordering table of the last flipped frame may still be being read, so look a frame or two back for GPU times
+		const FrameStats &GetFrameStats(size_t ago);
+		/// @brief Draws a bar graph of the frame profiler records
+		/// @param layer Ordering table layer
+		/// @param ot Ordering table index
+		/// @param x Left of the graph
+		/// @param y Bottom of the graph
+		/// @details Each frame is a column 3 pixels wide, with CPU time in green, time spent waiting in red, and GPU time in blue beside it
+		/// @details Each pixel is 4 scanlines, and a white line marks a whole frame
+		void DrawFrameStats(Layer layer, size_t ot, int16_t x, int16_t y);
+		/// @brief Output a summary of the frame profiler records to TTY
+		/// @details The average and maximum of each field are output in hex, for tracking regressions
+		void DumpFrameStats();
+
+		/// @brief Flip modes
+		enum FlipMode
+		{
+			/// @brief Flip waits for the GPU queue and vblank, then switches the display before drawing
+			FlipMode_Sync,
+			/// @brief Flip returns immediately, the display switch and draw are driven by the vblank and GPU DMA IRQs
+			FlipMode_Async,
+		};
+
 		/// @brief Flips and displays GPU buffers
 		/// @details After this, a draw command is pushed to the command queue.
+		/// @details In FlipMode_Async, the CPU only waits if the buffer it's flipping to is still being read by the GPU.
 		void Flip();
 
+		/// @brief Sets the flip mode
+		/// @param mode FlipMode
+		/// @returns Previous FlipMode
+		/// @details Any frames still in flight are displayed before the mode changes
+		/// @details Defaults to FlipMode_Sync
+		FlipMode SetFlipMode(FlipMode mode);
+
+		/// @brief Gets the flip mode
+		/// @returns FlipMode
+		FlipMode GetFlipMode();
+
 		/// @brief Waits for next VBlank
 		void VBlankSync();
 
@@ -743,8 +1046,9 @@ namespace CKSDK
 		* @{
 		**/
 		/// @brief Waits for GPU command queue to be empty
+		/// @note Image loads held back by the upload budget aren't waited for
 		void QueueSync();
-		/// @brief Drops all queued GPU commands
+		/// @brief Drops all queued GPU commands and pending image loads
 		void QueueReset();
 
 		/// @brief DMA ordering table to GPU
@@ -763,34 +1067,67 @@ namespace CKSDK
 		/// @note This is an asynchronous command, so the given pointer must be valid until the queue is empty
 		void Queue_ImageDMA(const void *addr, uint32_t xy, uint32_t wh, uint32_t bcr);
 
+		/// @brief Maximum number of image loads waiting to be queued
+		static constexpr size_t UPLOAD_MAX = 16;
+		/// @brief Largest image DMA chunk in bytes
+		static constexpr size_t UPLOAD_CHUNK_SIZE = 0x8000;
+
 		/// @brief Loads image to VRAM
-		/// @param addr Address of image data
+		/// @param addr Address of image data, which must be word aligned
+		/// @param x X coordinate in VRAM
+		/// @param y Y coordinate in VRAM
+		/// @param w Width in VRAM
+		/// @param h Height in VRAM
+		/// @details This is a wrapper around Queue_ImageDMA that constructs the DMA arguments for you
+		/// @details The image is split into bands of rows of up to UPLOAD_CHUNK_SIZE bytes, each its own DMA, so images of any size can be loaded
+		/// @details Bands are fed to the queue as it has room, and no faster than the budget given to SetUploadBudget
+		/// @note This is an asynchronous command, so the given pointer must be valid until UploadsPending is 0 and the queue is empty
+		void Queue_ImageLoad(const void *addr, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+		/// @brief Limit how many bytes of image loads are sent to the GPU each frame
+		/// @param bytes Bytes per frame, or 0 for no limit
+		/// @return Previous budget
+		/// @details Without a limit, Flip waits for every image load to be queued, so they all finish before the frame's ordering table
+		/// @details With a limit, the rest of a load is held back until the next Flip, so a big load can take several frames instead of stalling one
+		/// @details At least one band is sent each frame, even if it's bigger than the budget
+		size_t SetUploadBudget(size_t bytes);
+		/// @brief Get the number of image loads not fully queued yet
+		/// @return Number of image loads pending
+		size_t UploadsPending();
+
+		/// @brief Image transfer callback type
+		typedef OS::Function<void> TransferCallback;
+
+		/// @brief Reads image from VRAM
+		/// @param addr Address to read image data to, which must be word aligned
 		/// @param x X coordinate in VRAM
 		/// @param y Y coordinate in VRAM
 		/// @param w Width in VRAM
 		/// @param h Height in VRAM
-		/// @details This is a wrapper around DMAImage that constructs the DMA arguments for you
+		/// @param cb Callback for when the image has been read, invoked during the GPU DMA IRQ
+		/// @details The image is read as 16-bit pixels, rounded up to a whole word
+		/// @details Large images are read in bands of rows, taking a queue entry each, and this waits until the queue has room for all of them. The callback is invoked once the last band has been read. If w or h is 0, the callback is invoked immediately.
+		/// @note This is an asynchronous command, so the given pointer must be valid until the callback is invoked or the queue is empty
+		void Queue_ImageStore(void *addr, uint16_t x, uint16_t y, uint16_t w, uint16_t h, TransferCallback cb = nullptr);
+
+		/// @brief Copies a rectangle of VRAM to another position in VRAM
+		/// @param sx Source X coordinate in VRAM
+		/// @param sy Source Y coordinate in VRAM
+		/// @param dx Destination X coordinate in VRAM
+		/// @param dy Destination Y coordinate in VRAM
+		/// @param w Width in VRAM
+		/// @param h Height in VRAM
+		/// @param cb Callback for when the copy is done, invoked during the GPU IRQ
+		/// @details The copy runs on the GPU, and the GPU IRQ tells us when it's done so the queue can move on
+		void Queue_VRAMCopy(uint16_t sx, uint16_t sy, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h, TransferCallback cb = nullptr);
+
+		/// @brief DMA a command buffer to GP0 in block mode
+		/// @param addr Address of the commands
+		/// @param words Number of words
+		/// @details Unlike an ordering table, the commands are a contiguous buffer without tags, so the DMA doesn't have to follow links
+		/// @details Buffers too large for one DMA are sent in chunks, taking a queue entry each. No-operation if words is 0.
 		/// @note This is an asynchronous command, so the given pointer must be valid until the queue is empty
-		inline void Queue_ImageLoad(const void *addr, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
-		{
-			uint32_t bcr = w * h;
-			// if (bcr & 1)
-			// 	ExScreen::Abort("LoadImage w * h is odd");
-			bcr >>= 1;
-
-			uint32_t bs = 1;
-			while (((bcr & 1) == 0) && (bs < 16))
-			{
-				bs <<= 1;
-				bcr >>= 1;
-			}
-
-			// if (bcr >= 65536)
-			// 	ExScreen::Abort("LoadImage bcr too large");
-			bcr <<= 16;
-			bcr |= bs;
-			Queue_ImageDMA(addr, (x << 0) | (y << 16), (w << 0) | (h << 16), bcr);
-		}
+		void Queue_CommandDMA(const Word *addr, size_t words);
 
 		/// @brief Queue a list of GP1 commands
 		/// @param addr Pointer to the GP1 commands
@@ -849,40 +1186,487 @@ namespace CKSDK
 		**/
 
 		// GPU packet functions
+		/// @brief Allocates a packet that didn't fit in the current buffer
+		/// @param words Packet size, including its tag
+		/// @return Packet tag pointer
+		/// @details The buffer appears full while its ordering tables are being cleared, so this first waits for the clear
+		/// @details Moves the current buffer to its overflow page, aborting if there is none or the packet doesn't fit
+		/// @note For internal use only
+		Word *AllocOverflow(size_t words);
+
 		/// @brief Allocates and links a packet of a given size
+		/// @param layer Ordering table layer
 		/// @param ot Ordering table index
 		/// @param words Packet size
 		/// @return Packet
 		/// @details Allocates and links a packet of a given size onto the given ordering table
 		/// @details Packets are linked in reverse order, but the primitives within the packet will run in the order they are written
-		inline Word *AllocPacket(size_t ot, size_t words)
+		/// @details If the buffer is full, the packet is allocated from the overflow page set by SetOverflowBuffer
+		inline Word *AllocPacket(Layer layer, size_t ot, size_t words)
 		{
-			Tag *otp = (Tag*)&g_bufferp->GetOT(ot);
+			Tag *otp = (Tag*)&g_bufferp->GetOT(layer, ot);
+			g_bufferp->layer_used |= (1U << layer);
 			Word *prip = g_bufferp->prip;
+			Word *next = prip + words + 1;
+
+			if (next > g_bufferp->prie)
+			{
+				prip = AllocOverflow(words + 1);
+				next = prip + words + 1;
+			}
 
 			new(prip) Tag(otp->Ptr(), words);
 			new(otp) Tag(prip, 0);
 
-			g_bufferp->prip = prip + words + 1;
+			g_bufferp->prip = next;
+			g_bufferp->packets++;
 			return prip + 1;
 		}
 
+		/// @brief Allocates and links a packet of a given size onto layer 0
+		/// @param ot Ordering table index
+		/// @param words Packet size
+		/// @return Packet
+		inline Word *AllocPacket(size_t ot, size_t words)
+		{
+			return AllocPacket(Layer(0), ot, words);
+		}
+
 		/// @brief Allocates and links a packet of a given type
 		/// @tparam T Packet type
+		/// @param layer Ordering table layer
 		/// @param ot Ordering table index
 		/// @return Packet
 		/// @details Allocates, constructs, and links a packet of a given size onto the given ordering table
 		/// @details Packets are linked in reverse order, but the primitives within the packet will run in the order they are written
 		/// @note The packet type must not be larger than 16 words, as this will overflow the GPU's FIFO
 		template <typename T>
-		inline T &AllocPacket(size_t ot)
+		inline T &AllocPacket(Layer layer, size_t ot)
 		{
 			static_assert((sizeof(T) / sizeof(Word)) <= 16, "Packet type too big");
 
-			T &packet = *((T*)AllocPacket(ot, sizeof(T) / sizeof(Word)));
+			T &packet = *((T*)AllocPacket(layer, ot, sizeof(T) / sizeof(Word)));
 			new (&packet) T();
 			return packet;
 		}
+
+		/// @brief Allocates and links a packet of a given type
+		/// @tparam T Packet type
+		/// @param ot Ordering table index
+		/// @return Packet
+		/// @details Allocates, constructs, and links a packet of a given size onto the given ordering table of layer 0
+		/// @details Packets are linked in reverse order, but the primitives within the packet will run in the order they are written
+		/// @note The packet type must not be larger than 16 words, as this will overflow the GPU's FIFO
+		template <typename T>
+		inline T &AllocPacket(size_t ot)
+		{
+			return AllocPacket<T>(Layer(0), ot);
+		}
+
+		// Line batches
+		/// @brief Links separate lines of one color, packed into as few packets as possible
+		/// @param layer Ordering table layer
+		/// @param ot Ordering table index
+		/// @param c Line color
+		/// @param points Start and end points of each line
+		/// @param lines Number of lines
+		/// @param semi `true` if semi-transparent
+		/// @details Packets are kept to the 16 word FIFO size, so up to 5 lines are sent per packet
+		void AddLines(Layer layer, size_t ot, Color c, const ScreenCoord *points, size_t lines, bool semi);
+		/// @brief Links separate gradient lines, packed into as few packets as possible
+		/// @param layer Ordering table layer
+		/// @param ot Ordering table index
+		/// @param colors Color of each point
+		/// @param points Start and end points of each line
+		/// @param lines Number of lines
+		/// @param semi `true` if semi-transparent
+		/// @details Packets are kept to the 16 word FIFO size, so up to 4 lines are sent per packet
+		void AddLines(Layer layer, size_t ot, const Color *colors, const ScreenCoord *points, size_t lines, bool semi);
+		/// @brief Links a connected line of one color through any number of points
+		/// @param layer Ordering table layer
+		/// @param ot Ordering table index
+		/// @param c Line color
+		/// @param points Points to connect
+		/// @param count Number of points
+		/// @param semi `true` if semi-transparent
+		/// @details The line is split into poly-lines of up to 14 points, so each fits the 16 word FIFO size with its terminator
+		void AddPolyLine(Layer layer, size_t ot, Color c, const ScreenCoord *points, size_t count, bool semi);
+
+		// Draw environment stack
+		/// @brief Maximum depth of the draw environment stack
+		static constexpr size_t DRAW_STACK_MAX = 8;
+
+		/// @brief Draws to another area from an ordering table slot on
+		/// @param layer Ordering table layer
+		/// @param ot Ordering table index
+		/// @param env Draw environment, such as one for a render target from VRAMAllocator::AllocTarget
+		/// @details A packet setting the draw area and offset is linked, and the environment is pushed onto a stack that starts at the buffer's own each frame
+		/// @details Ordering tables are drawn from the highest index down, and a slot's packets in reverse order of allocation, so push at a later point in the drawing than the packets it's for, and call the pushes and pops in the order they'll be drawn
+		void PushDrawEnvironment(Layer layer, size_t ot, const DrawEnvironment &env);
+		/// @brief Draws to another area from an ordering table slot of layer 0 on
+		/// @param ot Ordering table index
+		/// @param env Draw environment
+		inline void PushDrawEnvironment(size_t ot, const DrawEnvironment &env) { PushDrawEnvironment(Layer(0), ot, env); }
+
+		/// @brief Clips drawing to a rectangle from an ordering table slot on
+		/// @param layer Ordering table layer
+		/// @param ot Ordering table index
+		/// @param rect Clip rectangle, in the coordinates of the current draw offset
+		/// @details The rectangle is clipped to the current draw area and keeps its offset, so it's a cheap way to clip a UI panel
+		void PushClip(Layer layer, size_t ot, const Rect &rect);
+		/// @brief Clips drawing to a rectangle from an ordering table slot of layer 0 on
+		/// @param ot Ordering table index
+		/// @param rect Clip rectangle
+		inline void PushClip(size_t ot, const Rect &rect) { PushClip(Layer(0), ot, rect); }
+
+		/// @brief Restores the previous draw environment from an ordering table slot on
+		/// @param layer Ordering table layer
+		/// @param ot Ordering table index
+		/// @details The texture cache is flushed too, so an area that was drawn to can be used as a texture after this
+		void PopDrawEnvironment(Layer layer, size_t ot);
+		/// @brief Restores the previous draw environment from an ordering table slot of layer 0 on
+		/// @param ot Ordering table index
+		inline void PopDrawEnvironment(size_t ot) { PopDrawEnvironment(Layer(0), ot); }
+
+		/// @brief Pre-recorded chain of packets
+		/// @details Packets are recorded once into persistent memory, then the whole chain can be linked into an ordering table slot each frame in constant time.
+		/// @details Linking rewrites the tag of the chain's last packet, so End keeps a copy of the chain for each GPU buffer. This stops a frame the GPU is still reading from being relinked into the frame being built.
+		/// @note Record display lists after SetBuffer, as the number of copies is taken from the buffer count.
+		class DisplayList
+		{
+			private:
+				// Recording buffer
+				Word *base = nullptr, *end = nullptr;
+				Word *prip = nullptr;
+				Word *last = nullptr;
+
+				// Recorded chain
+				size_t words = 0;
+				size_t copies = 0;
+
+			public:
+				/// @brief Begin recording
+				/// @param buffer Buffer to record into, which must stay valid for as long as the display list is linked
+				/// @param size Size of buffer in words, including the copies made by End
+				void Begin(Word *buffer, size_t size);
+
+				/// @brief Records a packet of a given size
+				/// @param words Packet size
+				/// @return Packet
+				/// @details Unlike AllocPacket, packets run in the order they are recorded
+				Word *Alloc(size_t words);
+
+				/// @brief Records a packet of a given type
+				/// @tparam T Packet type
+				/// @return Packet
+				/// @note The packet type must not be larger than 16 words, as this will overflow the GPU's FIFO
+				template <typename T>
+				T &Alloc()
+				{
+					static_assert((sizeof(T) / sizeof(Word)) <= 16, "Packet type too big");
+
+					T &packet = *((T*)Alloc(sizeof(T) / sizeof(Word)));
+					new (&packet) T();
+					return packet;
+				}
+
+				/// @brief Finish recording
+				/// @details Copies the recorded chain for each GPU buffer, aborting if the buffer passed to Begin is too small
+				void End();
+
+				/// @brief Links the display list onto an ordering table
+				/// @param layer Ordering table layer
+				/// @param ot Ordering table index
+				/// @note A display list may only be linked once per frame
+				void Link(Layer layer, size_t ot);
+
+				/// @brief Links the display list onto an ordering table of layer 0
+				/// @param ot Ordering table index
+				/// @note A display list may only be linked once per frame
+				void Link(size_t ot) { Link(Layer(0), ot); }
+
+				/// @brief Patches a recorded word in every copy
+				/// @param word Pointer to the word, within a packet returned by Alloc
+				/// @param value Value to write
+				/// @details Use this to change offsets or colors without recording again. A frame the GPU is still reading may see the new value early.
+				void Patch(const Word *word, Word value);
+
+				/// @brief Gets the size of the recorded chain
+				/// @return Size of one copy of the chain in words
+				size_t Words() const { return words; }
+		};
+
+		/// @brief Batches sprites to minimize draw mode changes
+		/// @details Sprites take their texture page from the draw mode, so drawing sprites from different texture pages needs a DrawMode command between them.
+		/// @details The batch collects sprites with their draw mode and a batch layer, then Flush stable-sorts them by batch layer, draw mode, and CLUT. Lower batch layers are always drawn first, and sprites with the same key keep the order they were added in.
+		/// @details Sprites are emitted in packets of up to 16 words, with a DrawMode command only where the draw mode changes.
+		class SpriteBatch
+		{
+			public:
+				/// @brief Batched sprite
+				struct Sprite
+				{
+					/// @brief Sort key (batch layer, texture page, CLUT)
+					uint32_t key;
+					/// @brief Draw mode
+					DrawMode mode;
+					/// @brief Sprite primitive
+					SpritePrim<> prim;
+				};
+
+				/// @brief Gets the buffer size needed for a number of sprites
+				/// @param capacity Maximum number of sprites
+				/// @return Buffer size in bytes
+				static constexpr size_t BufferSize(size_t capacity)
+				{ return capacity * (sizeof(Sprite) + sizeof(Sprite*) * 2); }
+
+			private:
+				// Sprite buffer and sort buffers
+				Sprite *sprites = nullptr;
+				Sprite **order = nullptr, **temp = nullptr;
+				size_t capacity = 0, count = 0;
+
+				// Statistics
+				Word last_mode = 0;
+				uint32_t switches = 0, switches_unsorted = 0;
+
+				void Sort();
+
+			public:
+				/// @brief Initialize the sprite batch
+				/// @param buffer Buffer to use, at least BufferSize(capacity) bytes and 4 byte aligned
+				/// @param capacity Maximum number of sprites
+				void Init(void *buffer, size_t capacity);
+
+				/// @brief Add a sprite to the batch
+				/// @param layer Batch layer, lower layers are drawn first
+				/// @param mode Draw mode
+				/// @param prim Sprite primitive, whose UV word holds the CLUT
+				/// @return `false` if the batch is full
+				bool Add(uint8_t layer, DrawMode mode, const SpritePrim<> &prim);
+
+				/// @brief Sort the batch and link it onto an ordering table
+				/// @param layer Ordering table layer
+				/// @param ot Ordering table index
+				/// @details The batch is empty afterwards
+				void Flush(Layer layer, size_t ot);
+
+				/// @brief Sort the batch and link it onto an ordering table of layer 0
+				/// @param ot Ordering table index
+				/// @details The batch is empty afterwards
+				void Flush(size_t ot) { Flush(Layer(0), ot); }
+
+				/// @brief Gets the number of sprites in the batch
+				/// @return Number of sprites
+				size_t Count() const { return count; }
+
+				/// @brief Gets the number of DrawMode commands emitted
+				/// @return DrawMode commands emitted since Init or ResetStats
+				uint32_t ModeSwitches() const { return switches; }
+				/// @brief Gets the number of DrawMode commands saved by sorting
+				/// @return DrawMode commands that would have been emitted in the order sprites were added, minus those actually emitted
+				uint32_t ModeSwitchesSaved() const { return switches_unsorted - switches; }
+				/// @brief Resets the mode switch counters
+				void ResetStats() { switches = switches_unsorted = 0; }
+		};
+
+		/// @brief VRAM area allocator
+		/// @details VRAM is tracked in cells of 8x8 units (16-bit pixels), a byte per row of cells in each texture page.
+		/// @details Textures never cross a texture page, as texture coordinates can't address past one. CLUTs are packed eight to a block of cell rows, keeping their 16 unit X alignment.
+		class VRAMAllocator
+		{
+			public:
+				/// @brief Size of a cell in VRAM units
+				static constexpr unsigned CELL_SIZE = 8;
+				/// @brief Maximum number of CLUT blocks
+				static constexpr unsigned CLUT_BLOCK_MAX = 32;
+
+			private:
+				// Cell occupancy, indexed by cell row then texture page column
+				uint8_t cells[512 / CELL_SIZE][1024 / 64];
+
+				// CLUT blocks
+				struct ClutBlock
+				{
+					uint16_t x, y, w;
+					uint8_t used;
+				} clut_blocks[CLUT_BLOCK_MAX];
+				unsigned clut_block_count;
+
+				void MarkCells(const Rect &rect, bool used);
+				bool FindCells(unsigned w, unsigned h, unsigned align, Rect *rect);
+
+			public:
+				/// @brief Initialize the allocator
+				/// @details Everything is freed, then the framebuffers set by SetScreen are reserved
+				void Init();
+
+				/// @brief Reserve an area of VRAM
+				/// @param rect Area in VRAM units
+				void Reserve(const Rect &rect);
+				/// @brief Release a reserved area of VRAM
+				/// @param rect Area in VRAM units
+				void Release(const Rect &rect) { MarkCells(rect, false); }
+
+				/// @brief Allocate an area for a texture
+				/// @param w Width in texels
+				/// @param h Height in texels
+				/// @param bpp Texture bit depth
+				/// @param rect Rect to store the area in VRAM units in
+				/// @return `false` if there's no space
+				/// @details Textures can be at most a texture page (64x256 units) in size
+				bool AllocTexture(uint16_t w, uint16_t h, BitDepth bpp, Rect *rect);
+				/// @brief Free a texture area
+				/// @param rect Area returned by AllocTexture
+				void FreeTexture(const Rect &rect) { MarkCells(rect, false); }
+
+				/// @brief Allocate an area for an offscreen render target
+				/// @param w Width in pixels
+				/// @param h Height in pixels
+				/// @param rect Rect to store the area in VRAM units in
+				/// @return `false` if there's no space
+				/// @details Targets can be at most 256x256 pixels, and are placed so they can be used as a 15-bit texture with GetTexPage and GetTexCoord
+				bool AllocTarget(uint16_t w, uint16_t h, Rect *rect);
+				/// @brief Free a render target area
+				/// @param rect Area returned by AllocTarget
+				void FreeTarget(const Rect &rect) { MarkCells(rect, false); }
+
+				/// @brief Allocate an area for a CLUT
+				/// @param entries Number of CLUT entries, 16 or 256
+				/// @param rect Rect to store the area in VRAM units in
+				/// @return `false` if there's no space
+				bool AllocClut(uint16_t entries, Rect *rect);
+				/// @brief Free a CLUT area
+				/// @param rect Area returned by AllocClut
+				void FreeClut(const Rect &rect);
+
+				/// @brief Gets the number of free cells
+				/// @return Number of free cells
+				unsigned FreeCells() const;
+
+				/// @brief Gets the texture page of a texture area
+				/// @param rect Texture area
+				/// @param semi Semi transparency mode
+				/// @param bpp Texture bit depth
+				/// @return TexPage
+				static TexPage GetTexPage(const Rect &rect, SemiMode semi, BitDepth bpp)
+				{ return TexPage(rect.x >> 6, rect.y >> 8, semi, bpp); }
+
+				/// @brief Gets the texture coordinates of the top left of a texture area
+				/// @param rect Texture area
+				/// @param bpp Texture bit depth
+				/// @return TexCoord
+				static TexCoord GetTexCoord(const Rect &rect, BitDepth bpp)
+				{ return TexCoord((rect.x & 63) << (2 - bpp), rect.y & 255); }
+
+				/// @brief Gets the Clut of a CLUT area
+				/// @param rect CLUT area
+				/// @return Clut
+				static Clut GetClut(const Rect &rect)
+				{ return Clut(rect.x >> 4, rect.y); }
+		};
+
+		/// @brief LRU texture residency cache
+		/// @details Textures are registered with their data in main RAM, and uploaded to VRAM when they're used. When VRAM runs out, the least recently used textures are evicted, so more texture data can be used than VRAM holds.
+		/// @details Textures used in the last BUFFER_MAX frames are never evicted, as frames still being drawn may reference them.
+		/// @note The texture cache is not IRQ safe, only use it on the CPU thread.
+		class TextureCache
+		{
+			public:
+				/// @brief Cached texture
+				/// @details Storage is provided by the caller, and must stay valid while registered
+				struct Texture
+				{
+					/// @brief Texel data in main RAM
+					const void *data;
+					/// @brief CLUT data in main RAM, null for 15-bit textures
+					const void *clut_data;
+					/// @brief Width in texels
+					uint16_t w;
+					/// @brief Height in texels
+					uint16_t h;
+					/// @brief Texture bit depth
+					BitDepth bpp;
+
+					/// @brief Texture area while resident
+					Rect rect;
+					/// @brief CLUT area while resident
+					Rect clut_rect;
+					/// @brief Frame the texture was last used in
+					uint32_t last_used;
+					/// @brief `true` if the texture is in VRAM
+					bool resident = false;
+
+					/// @brief LRU list links
+					Texture *prev, *next;
+				};
+
+			private:
+				// Allocator and LRU list, oldest first
+				VRAMAllocator *allocator = nullptr;
+				Texture *lru_head = nullptr, *lru_tail = nullptr;
+				uint32_t frame = 0;
+
+				// Statistics
+				uint32_t uploads = 0, evictions = 0;
+
+				void Evict(Texture &texture);
+				bool EvictOldest();
+
+			public:
+				/// @brief Initialize the texture cache
+				/// @param allocator Allocator to take VRAM from
+				void Init(VRAMAllocator *allocator);
+
+				/// @brief Register a texture
+				/// @param texture Texture storage
+				/// @param data Texel data in main RAM, which must stay valid while registered
+				/// @param clut_data CLUT data in main RAM, null for 15-bit textures
+				/// @param w Width in texels
+				/// @param h Height in texels
+				/// @param bpp Texture bit depth
+				/// @details If the texture is already resident, such as when a slot is reused for a new level, its VRAM is freed first
+				/// @note As with Unregister, a resident texture must not have been used in the last BUFFER_MAX frames
+				void Register(Texture &texture, const void *data, const void *clut_data, uint16_t w, uint16_t h, BitDepth bpp);
+				/// @brief Unregister a texture, freeing its VRAM
+				/// @param texture Texture
+				/// @note The texture must not have been used in the last BUFFER_MAX frames
+				void Unregister(Texture &texture);
+
+				/// @brief Use a texture this frame
+				/// @param texture Texture
+				/// @return `false` if the texture couldn't be made resident
+				/// @details If the texture isn't resident, space is allocated (evicting old textures as needed) and an upload is queued with Queue_ImageLoad, which runs before the frame's ordering table unless SetUploadBudget has held it back
+				bool Use(Texture &texture);
+
+				/// @brief Advance to the next frame
+				/// @details Call this once per frame, such as after Flip
+				void Tick() { frame++; }
+
+				/// @brief Gets the number of uploads
+				/// @return Uploads since Init
+				uint32_t Uploads() const { return uploads; }
+				/// @brief Gets the number of evictions
+				/// @return Evictions since Init to make room for other textures, not counting Unregister
+				uint32_t Evictions() const { return evictions; }
+
+				/// @brief Gets the texture page of a resident texture
+				/// @param texture Texture
+				/// @param semi Semi transparency mode
+				/// @return TexPage
+				static TexPage GetTexPage(const Texture &texture, SemiMode semi = SemiMode_Blend)
+				{ return VRAMAllocator::GetTexPage(texture.rect, semi, texture.bpp); }
+				/// @brief Gets the texture coordinates of the top left of a resident texture
+				/// @param texture Texture
+				/// @return TexCoord
+				static TexCoord GetTexCoord(const Texture &texture)
+				{ return VRAMAllocator::GetTexCoord(texture.rect, texture.bpp); }
+				/// @brief Gets the Clut of a resident texture
+				/// @param texture Texture
+				/// @return Clut
+				static Clut GetClut(const Texture &texture)
+				{ return VRAMAllocator::GetClut(texture.clut_rect); }
+		};
 		
 		/// @brief Wait until GPU is ready to receive command word
 		inline void CmdSync() { while ((OS::GpuGp1() & (1 << 26)) == 0); }
@@ -907,24 +1691,96 @@ namespace CKSDK
 			OS::GpuGp0() = cmd;
 		}
 
+		/// @brief Size of the GP0 FIFO in words
+		static constexpr size_t GP0_FIFO_WORDS = 16;
+
+		/// @brief Sends a burst of commands to the GP0 port
+		/// @param words Commands
+		/// @param count Number of words, at most GP0_FIFO_WORDS
+		/// @details This waits for the GPU to be ready for a command once, then fills the FIFO without polling
+		/// @note The burst must only contain whole commands, as the GPU isn't ready for a command while it's waiting for the rest of one
+		inline void GP0_Burst(const Word *words, size_t count)
+		{
+			CmdSync();
+			for (const Word *worde = words + count; words != worde; words++)
+				OS::GpuGp0() = *words;
+		}
+
 		/// @brief Sends a packet to the GP0 port
 		/// @tparam T Packet type
 		/// @param packet Packet
+		/// @details Packets that fit in the GP0 FIFO are sent as a single burst
 		template <typename T>
 		inline void GP0_Packet(const T &packet)
 		{
 			Word *wordp = (Word*)&packet;
 			Word *worde = wordp + (sizeof(T) / sizeof(Word));
 
-			CmdSync();
-			for (; wordp != worde; wordp++)
+			if constexpr ((sizeof(T) / sizeof(Word)) <= GP0_FIFO_WORDS)
+			{
+				GP0_Burst(wordp, worde - wordp);
+			}
+			else
 			{
-				DataSync();
-				OS::GpuGp0() = *wordp;
+				CmdSync();
+				for (; wordp != worde; wordp++)
+				{
+					DataSync();
+					OS::GpuGp0() = *wordp;
+				}
 			}
 			CmdSync();
 		}
 
+		/// @brief Immediate mode GP0 command writer
+		/// @details Commands are collected into a FIFO sized burst, which is sent with GP0_Burst once the next command doesn't fit.
+		/// @details Use this to draw directly to the GPU without an ordering table, such as for loading screens and debug overlays.
+		class GP0_Writer
+		{
+			private:
+				Word words[GP0_FIFO_WORDS];
+				size_t count = 0;
+
+			public:
+				/// @brief Destructor, sends any remaining commands
+				~GP0_Writer() { Flush(); }
+
+				/// @brief Allocates a command
+				/// @param size Command size in words, at most GP0_FIFO_WORDS
+				/// @return Command words
+				Word *Alloc(size_t size)
+				{
+					if ((count + size) > GP0_FIFO_WORDS)
+						Flush();
+					Word *wordp = &words[count];
+					count += size;
+					return wordp;
+				}
+
+				/// @brief Allocates a command of a given type
+				/// @tparam T Command type
+				/// @return Command
+				template <typename T>
+				T &Alloc()
+				{
+					static_assert((sizeof(T) / sizeof(Word)) <= GP0_FIFO_WORDS, "Packet type too big");
+
+					T &packet = *((T*)Alloc(sizeof(T) / sizeof(Word)));
+					new (&packet) T();
+					return packet;
+				}
+
+				/// @brief Sends the collected commands
+				void Flush()
+				{
+					if (count != 0)
+					{
+						GP0_Burst(words, count);
+						count = 0;
+					}
+				}
+		};
+
 		/// @brief Sends a word to the GP1 port
 		/// @param cmd Word
 		inline void GP1_Cmd(Word cmd)
@@ -22,17 +22,96 @@
 
 #include <CKSDK/CKSDK.h>
 
+#include <type_traits>
+
+// C externs
+extern "C"
+{
+	void CKSDK_Mem_ScratchCall(void (*func)(void*), void *arg, void *sp);
+}
+
 /// @brief CKSDK namespace
 namespace CKSDK
 {
 	/// @brief CKSDK Memory allocation namespace
 	/// @note `new` and `delete` wrap these functions and handle construction and destruction. Only use these if you know what you are doing.
+	/// @details The heap is a TLSF (two-level segregated fit) allocator, so allocating and freeing take constant time regardless of how many blocks are live.
+	/// @details Define `CKSDK_MEM_FIRSTFIT` to use the old first-fit allocator instead, for comparison.
+	/// @details Define `CKSDK_MEM_DEBUG` to record which caller made each allocation, for Report.
+	/// @details Memory can be split across multiple named heaps, such as expansion RAM on 8 MiB units. Allocations are routed to heaps by Tag.
 	namespace Mem
 	{
+		// Mem types
+		/// @brief Allocation tags
+		/// @details Each tag is routed to a heap, see SetHeap. All tags are routed to the main heap by default.
+		enum Tag
+		{
+			/// @brief General allocations, including `new` and EASTL
+			Tag_General,
+			/// @brief Large asset buffers, routed to the expansion heap if there is one
+			Tag_Asset,
+			/// @brief First tag free for application use
+			Tag_User,
+
+			/// @brief Number of tags
+			Tag_Count = 8
+		};
+
+		/// @brief Heap handle
+		/// @details A heap keeps its control structure at the start of the region it was created over
+		struct Heap;
+
+		/// @brief Heap statistics
+		struct Stats
+		{
+			/// @brief Used memory, including block headers
+			size_t used;
+			/// @brief Total memory
+			size_t total;
+			/// @brief Number of allocated blocks
+			size_t blocks;
+			/// @brief Highest used memory since the heap was created or ResetPeak was called
+			size_t peak;
+			/// @brief Size of the largest free block, including its header
+			size_t largest_free;
+			/// @brief Number of free blocks
+			size_t free_blocks;
+		};
+
+		// Heap management functions
+		/// @brief Create a heap over a region of memory
+		/// @param ptr Pointer to the region
+		/// @param size Size of the region
+		/// @param name Name of the heap, which must stay valid
+		/// @return Heap, or `nullptr` if the region is too small or there are too many heaps
+		/// @details Up to 4 heaps can exist, including the main heap. Heaps can't be destroyed.
+		Heap *CreateHeap(void *ptr, size_t size, const char *name);
+		/// @brief Find a heap by name
+		/// @param name Name of the heap
+		/// @return Heap, or `nullptr` if no heap has the name
+		/// @details CKSDK creates `"Main"`, `"Kernel"` for the RAM below the executable, and `"Expansion"` for RAM past 2 MiB
+		Heap *FindHeap(const char *name);
+		/// @brief Get the name of a heap
+		/// @param heap Heap
+		/// @return Name of the heap
+		const char *HeapName(const Heap *heap);
+
+		/// @brief Route a tag to a heap
+		/// @param tag Tag
+		/// @param heap Heap to route the tag to, or `nullptr` for the main heap
+		/// @return Heap the tag was previously routed to
+		/// @note Memory is always freed to the heap it was allocated from, so tags can be rerouted at any time
+		Heap *SetHeap(Tag tag, Heap *heap);
+		/// @brief Get the heap a tag is routed to
+		/// @param tag Tag
+		/// @return Heap
+		Heap *GetHeap(Tag tag);
+
 		// Mem functions
 		/// @brief Initialize the memory allocator
 		/// @param ptr Pointer to the heap to use
 		/// @param addr Size of the heap to use
+		/// @details This creates the main heap and routes all tags to it
 		/// @note For internal use only
 		void Init(void *ptr, size_t addr);
 		
@@ -40,11 +119,44 @@ namespace CKSDK
 		/// @param size Size of the memory to allocate
 		/// @return Pointer to the allocated memory
 		void *Alloc(size_t size);
+		/// @brief Allocate memory from the heap a tag is routed to
+		/// @param size Size of the memory to allocate
+		/// @param tag Tag
+		/// @return Pointer to the allocated memory
+		void *Alloc(size_t size, Tag tag);
+		/// @brief Allocate memory from a heap
+		/// @param heap Heap
+		/// @param size Size of the memory to allocate
+		/// @return Pointer to the allocated memory
+		void *Alloc(Heap *heap, size_t size);
+		/// @brief Allocate aligned memory
+		/// @param size Size of the memory to allocate
+		/// @param align Alignment of the memory, must be a power of 2
+		/// @param offset Offset into the memory which should be aligned, rounded down to a multiple of 8
+		/// @return Pointer to the allocated memory
+		/// @details Use this for cache-line aligned vertex arrays, SPU DMA chunks, and ordering tables. Memory is 8 byte aligned at minimum.
+		/// @note The alignment is not kept if Realloc has to move the memory
+		void *AllocAligned(size_t size, size_t align, size_t offset = 0);
+		/// @brief Allocate aligned memory from the heap a tag is routed to
+		/// @param size Size of the memory to allocate
+		/// @param align Alignment of the memory, must be a power of 2
+		/// @param offset Offset into the memory which should be aligned, rounded down to a multiple of 8
+		/// @param tag Tag
+		/// @return Pointer to the allocated memory
+		void *AllocAligned(size_t size, size_t align, size_t offset, Tag tag);
+		/// @brief Allocate aligned memory from a heap
+		/// @param heap Heap
+		/// @param size Size of the memory to allocate
+		/// @param align Alignment of the memory, must be a power of 2
+		/// @param offset Offset into the memory which should be aligned, rounded down to a multiple of 8
+		/// @return Pointer to the allocated memory
+		void *AllocAligned(Heap *heap, size_t size, size_t align, size_t offset = 0);
 		/// @brief Reallocate memory
 		/// @param ptr Pointer to the memory to reallocate
 		/// @param size Size of the memory to allocate
-		/// @return Pointer to the reallocated memory
-		/// @note No-operation if ptr is null
+		/// @return Pointer to the reallocated memory, or `nullptr` if there's no space (the old memory is left untouched)
+		/// @details Shrinking, and growing into free space directly after the block, are done in place without copying. Otherwise the data is moved to a new block in the same heap.
+		/// @note Equivalent to Alloc if ptr is null
 		void *Realloc(void *ptr, size_t size);
 		/// @brief Free memory
 		/// @param ptr Pointer to the memory to free
@@ -55,6 +167,281 @@ namespace CKSDK
 		/// @param used Pointer to a size_t to store the used memory in
 		/// @param total Pointer to a size_t to store the total memory in
 		/// @param blocks Pointer to a size_t to store the number of blocks in
+		/// @note This profiles the heap Tag_General is routed to
 		void Profile(size_t *used, size_t *total, size_t *blocks);
+		/// @brief Profile a heap
+		/// @param heap Heap
+		/// @param used Pointer to a size_t to store the used memory in
+		/// @param total Pointer to a size_t to store the total memory in
+		/// @param blocks Pointer to a size_t to store the number of blocks in
+		void Profile(Heap *heap, size_t *used, size_t *total, size_t *blocks);
+		/// @brief Profile reallocations
+		/// @param in_place Pointer to a size_t to store the number of reallocations done in place in
+		/// @param moved Pointer to a size_t to store the number of reallocations that moved the data in
+		/// @param copied Pointer to a size_t to store the total number of bytes copied by reallocations in
+		void ProfileRealloc(size_t *in_place, size_t *moved, size_t *copied);
+
+		/// @brief Get heap statistics
+		/// @param heap Heap
+		/// @param stats Stats to fill
+		/// @details With the TLSF heap this takes constant time, apart from walking the free list holding the largest blocks
+		void GetStats(Heap *heap, Stats *stats);
+		/// @brief Reset the high-water mark of a heap to its current usage
+		/// @param heap Heap
+		void ResetPeak(Heap *heap);
+
+		/// @brief Set the caller an allocation is attributed to
+		/// @param ptr Pointer to allocated memory
+		/// @param caller Caller, usually a return address
+		/// @details Allocations are attributed to the return address of the Mem function that made them. Wrappers such as `new` use this to attribute allocations to their own caller instead.
+		/// @note This is a no-operation unless CKSDK is built with `CKSDK_MEM_DEBUG`
+		void SetCaller(void *ptr, const void *caller);
+		/// @brief Output a heap report to TTY
+		/// @param heap Heap
+		/// @details The report contains the heap statistics and a histogram of free block sizes, to show how fragmented the heap is.
+		/// @details When CKSDK is built with `CKSDK_MEM_DEBUG`, the callers holding the most memory are listed too. Look their addresses up in the symbol map.
+		/// @note IRQs are disabled while the heap is walked
+		void Report(Heap *heap);
+
+		/// @brief CKSDK per-frame arena namespace
+		/// @details The frame arena is a double buffered bump allocator for data that only lives for a frame, such as visible object lists, sort keys, and temporary strings.
+		/// @details Allocating is a pointer bump, and there is no free. The arena is flipped by GPU::Flip, which resets the half that is about to be built into.
+		/// @details Memory allocated from the arena stays valid until the second GPU::Flip after it was allocated, so it may be referenced by packets in the frame's ordering table.
+		/// @note The frame arena is not IRQ safe, only allocate from it on the CPU thread.
+		namespace FrameArena
+		{
+			// Frame arena globals
+			/// @brief Current frame arena pointer
+			/// @note For internal use only
+			extern char *g_ptr;
+			/// @brief Current frame arena end
+			/// @note For internal use only
+			extern char *g_end;
+
+			// Frame arena functions
+			/// @brief Set frame arena buffer
+			/// @param buffer Buffer to use
+			/// @param size Size of buffer in bytes
+			/// @details This splits the given buffer into two for double buffering
+			/// @details Passing a null buffer disables the frame arena
+			void SetBuffer(void *buffer, size_t size);
+
+			/// @brief Flips and resets the frame arena
+			/// @note This is called by GPU::Flip
+			void Flip();
+
+			/// @brief Profile frame arena
+			/// @param used Pointer to a size_t to store the memory used this frame in
+			/// @param total Pointer to a size_t to store the size of each half in
+			void Profile(size_t *used, size_t *total);
+
+			/// @brief Allocate memory from the frame arena
+			/// @param size Size of the memory to allocate
+			/// @param align Alignment of the memory, must be a power of 2
+			/// @param offset Offset into the memory which should be aligned
+			/// @return Pointer to the allocated memory, or `nullptr` if the frame arena is exhausted
+			inline void *Alloc(size_t size, size_t align = 8, size_t offset = 0)
+			{
+				uintptr_t p = ((uintptr_t(g_ptr) + offset + (align - 1)) & ~(align - 1)) - offset;
+				uintptr_t e = p + size;
+				if (e > uintptr_t(g_end))
+					return nullptr;
+				g_ptr = (char*)e;
+				return (void*)p;
+			}
+		}
+
+		/// @brief CKSDK scratchpad allocator namespace
+		/// @details The scratchpad is 1 KiB of data cache mapped as RAM, and is the fastest memory available. Whatever isn't used by SCRATCHPAD variables is managed as a stack.
+		/// @details Allocations are released by popping back to a marker, either directly with Push and Pop or with a Scope.
+		/// @note The scratchpad allocator is not IRQ safe, only allocate from it on the CPU thread.
+		namespace Scratch
+		{
+			// Scratch globals
+			/// @brief Current scratchpad stack pointer
+			/// @note For internal use only
+			extern char *g_ptr;
+			/// @brief Scratchpad end
+			/// @note For internal use only
+			extern char *g_end;
+
+			// Scratch types
+			/// @brief Scratchpad stack marker
+			typedef char *Marker;
+
+			// Scratch functions
+			/// @brief Initialize the scratchpad allocator
+			/// @note For internal use only
+			void Init();
+
+			/// @brief Allocate memory from the scratchpad
+			/// @param size Size of the memory to allocate
+			/// @param align Alignment of the memory, must be a power of 2
+			/// @return Pointer to the allocated memory, or `nullptr` if the scratchpad is exhausted
+			inline void *Alloc(size_t size, size_t align = 4)
+			{
+				uintptr_t p = (uintptr_t(g_ptr) + (align - 1)) & ~(align - 1);
+				uintptr_t e = p + size;
+				if (e > uintptr_t(g_end))
+					return nullptr;
+				g_ptr = (char*)e;
+				return (void*)p;
+			}
+
+			/// @brief Get a marker to the current top of the scratchpad stack
+			/// @return Marker
+			inline Marker Push() { return g_ptr; }
+			/// @brief Release everything allocated since a marker
+			/// @param marker Marker returned by Push
+			inline void Pop(Marker marker) { g_ptr = marker; }
+
+			/// @brief Get the number of free bytes in the scratchpad
+			/// @return Free bytes
+			inline size_t Available() { return g_end - g_ptr; }
+
+			/// @brief Scoped scratchpad marker
+			/// @details Everything allocated from the scratchpad during the scope's lifetime is released when it's destructed
+			class Scope
+			{
+				private:
+					Marker marker;
+
+				public:
+					Scope() : marker(Push()) {}
+					~Scope() { Pop(marker); }
+
+					Scope(const Scope &) = delete;
+					Scope &operator=(const Scope &) = delete;
+			};
+
+			/// @brief Call a function with the stack in the scratchpad
+			/// @param func Function to call
+			/// @param arg Argument to pass to the function
+			/// @param size Stack size to reserve in bytes
+			/// @details Use this for hot loops that spill to the stack, such as GTE transform kernels
+			/// @details If there isn't enough free scratchpad, the function is called on the normal stack
+			/// @note IRQs are handled on the current stack, so leave headroom for the ISR and its callbacks
+			inline void Call(void (*func)(void*), void *arg, size_t size)
+			{
+				Marker marker = Push();
+				char *stack = (char*)Alloc(size, 8);
+				if (stack != nullptr)
+					::CKSDK_Mem_ScratchCall(func, arg, stack + (size & ~7));
+				else
+					func(arg);
+				Pop(marker);
+			}
+
+			/// @brief Call a functor with the stack in the scratchpad
+			/// @tparam F Functor type
+			/// @param func Functor to call
+			/// @param size Stack size to reserve in bytes
+			/// @overload
+			template <typename F>
+			inline void Call(F &&func, size_t size)
+			{
+				Call([](void *arg) { (*(std::remove_reference_t<F>*)arg)(); }, (void*)&func, size);
+			}
+		}
+
+		/// @brief EASTL allocator for the frame arena
+		/// @details Containers using this allocator must not outlive the frame they were filled in. Deallocation is a no-operation.
+		class FrameAllocator
+		{
+			public:
+				FrameAllocator(const char * = nullptr) {}
+				FrameAllocator(const FrameAllocator &, const char * = nullptr) {}
+
+				void *allocate(size_t n, int = 0) { return FrameArena::Alloc(n); }
+				void *allocate(size_t n, size_t alignment, size_t offset, int = 0) { return FrameArena::Alloc(n, alignment, offset); }
+				void deallocate(void *, size_t) {}
+
+				const char *get_name() const { return "FrameAllocator"; }
+				void set_name(const char *) {}
+
+				bool operator==(const FrameAllocator &) const { return true; }
+				bool operator!=(const FrameAllocator &) const { return false; }
+		};
+
+		/// @brief Relocatable memory handle
+		/// @details Handle 0 is the null handle
+		typedef uint16_t Handle;
+
+		/// @brief Relocatable handle heap
+		/// @details Memory in a handle heap is accessed through handles instead of pointers, so the heap can move it to defragment itself.
+		/// @details New memory is taken from the end of the heap, falling back to a first-fit search of the holes left by Free. Compact slides memory down over the holes a bounded number of bytes at a time, so it can be run every frame (such as from a flip callback) without hitches.
+		/// @details Pointers returned by Get are only valid until the next call to Compact. Lock memory that must stay in place for longer, such as while DMA is reading from it.
+		/// @note Handle heaps are not IRQ safe, only use them on the CPU thread.
+		class HandleHeap
+		{
+			private:
+				// Handle table, entries hold data pointers or free list links
+				uintptr_t *table;
+				unsigned free_handle;
+
+				// Heap bounds and usage
+				char *base, *top, *end;
+				size_t used;
+
+				// Compactor state
+				char *dest, *scan;
+				bool dirty;
+
+				void *Search(size_t size);
+
+			public:
+				/// @brief Initialize the handle heap
+				/// @param buffer Buffer to use, such as one allocated from Tag_Asset
+				/// @param size Size of the buffer in bytes
+				/// @param handles Maximum number of handles, up to 65535
+				/// @details The handle table is placed at the start of the buffer and takes 4 bytes per handle. The number of handles is reduced to what fits in the buffer, and if that leaves no usable handles, every allocation fails.
+				void Init(void *buffer, size_t size, unsigned handles);
+
+				/// @brief Allocate relocatable memory
+				/// @param size Size of the memory to allocate
+				/// @return Handle, or 0 if there's no space or no free handles
+				Handle Alloc(size_t size);
+				/// @brief Free relocatable memory
+				/// @param handle Handle to free
+				/// @note No-operation if handle is 0
+				void Free(Handle handle);
+
+				/// @brief Get the current address of relocatable memory
+				/// @param handle Handle
+				/// @return Pointer to the memory, or `nullptr` if handle is 0
+				void *Get(Handle handle) const { return (void*)table[handle]; }
+				/// @brief Get the current address of relocatable memory
+				/// @tparam T Type
+				/// @param handle Handle
+				/// @return Pointer to the memory, or `nullptr` if handle is 0
+				template <typename T>
+				T *Get(Handle handle) const { return (T*)table[handle]; }
+				/// @brief Get the size of relocatable memory
+				/// @param handle Handle
+				/// @return Size of the memory, rounded up to a multiple of 8, or 0 if handle is 0
+				size_t Size(Handle handle) const;
+
+				/// @brief Lock relocatable memory in place
+				/// @param handle Handle
+				/// @details Locks are counted, so each Lock must be paired with an Unlock
+				/// @note No-operation if handle is 0
+				void Lock(Handle handle);
+				/// @brief Unlock relocatable memory
+				/// @param handle Handle
+				/// @note No-operation if handle is 0
+				void Unlock(Handle handle);
+
+				/// @brief Incrementally compact the heap
+				/// @param budget Maximum number of bytes to move or scan
+				/// @return Number of bytes moved
+				/// @details Each call continues the current pass from where the last one stopped. Once a pass completes, the free space it gathered at the end of the heap is available for allocation.
+				size_t Compact(size_t budget);
+
+				/// @brief Profile the handle heap
+				/// @param used Pointer to a size_t to store the used memory in
+				/// @param total Pointer to a size_t to store the total memory in
+				/// @param contiguous Pointer to a size_t to store the free memory at the end of the heap in
+				void Profile(size_t *used, size_t *total, size_t *contiguous) const;
+		};
 	}
 }
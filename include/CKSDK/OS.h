@@ -343,6 +343,18 @@ namespace CKSDK
 		/// @brief PIO status port
 		inline constexpr volatile uint8_t &PioStatus() { return *((volatile uint8_t *)0xBF060005); }
 
+		// Scratchpad
+		/// @brief Scratchpad base address
+		static constexpr uintptr_t ScratchpadBase = 0x1F800000;
+		/// @brief Scratchpad size in bytes
+		static constexpr size_t ScratchpadSize = 0x400;
+
+		/// @brief Scratchpad memory
+		/// @tparam T Type to access the scratchpad as
+		/// @param offset Offset into the scratchpad in bytes
+		template <typename T>
+		inline T *Scratchpad(uintptr_t offset = 0) { return (T*)(ScratchpadBase + offset); }
+
 		// Clocks
 		/// @brief CPU clock rate
 		static constexpr uint32_t CpuHz = 33868800UL;
@@ -507,6 +519,11 @@ namespace CKSDK
 		/// @note If you are modifying code in memory, you must call this function to ensure the CPU executes the new code
 		void FlushICache();
 
+		/// @brief Get the amount of main RAM installed
+		/// @return Size of main RAM in bytes, 2 MiB on retail units and 8 MiB on most development units
+		/// @details RAM is detected by checking where it starts to mirror within the window set by RamSize
+		size_t RamInstalled();
+
 		/// @brief Wait for a number of cycles
 		/// @param cycles Number of cycles to wait
 		/// @note Cycles waited is approximate, but will be at least the number of cycles specified
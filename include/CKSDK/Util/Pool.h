@@ -0,0 +1,130 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+	
+	- Pool.h -
+	Fixed-size object pool
+*/
+
+/// @file CKSDK/Util/Pool.h
+/// @brief CKSDK object pool utility
+
+#pragma once
+
+#include <CKSDK/CKSDK.h>
+
+#include <utility>
+
+/// @brief CKSDK namespace
+namespace CKSDK
+{
+	/// @brief CKSDK pool namespace
+	namespace Pool
+	{
+		// Pool types
+		/// @brief Fixed-size object pool template
+		/// @tparam T Object type
+		/// @tparam N Pool capacity
+		/// @details Objects are taken from an intrusive free list, so acquiring and releasing are constant time and have no per-object header.
+		/// @details Storage is held inline and slots are handed out in order before the free list is used, so a zero-initialized pool is valid without running its constructor.
+		/// @details This means the pool can be placed in static storage (BSS) or the scratchpad, and its storage goes wherever the pool object goes.
+		/// @note Pools are not IRQ safe, disable IRQs around access if the pool is shared with an ISR.
+		template <typename T, unsigned N>
+		class Pool
+		{
+			static_assert(N != 0, "Pool capacity must not be zero");
+
+			private:
+				// Pool slots
+				union Slot
+				{
+					Slot *next;
+					alignas(T) char data[sizeof(T)];
+				} slots[N];
+				Slot *free_head = nullptr;
+				uint32_t free_tail = 0;
+				uint32_t used = 0, peak = 0;
+
+			public:
+				// Pool functions
+				/// @brief Acquire and construct an object
+				/// @param args Constructor arguments
+				/// @return Pointer to the object, or `nullptr` if the pool is exhausted
+				template <typename... Args>
+				T *Acquire(Args&&... args)
+				{
+					// Get slot, from the free list if possible
+					Slot *slot = free_head;
+					if (slot != nullptr)
+						free_head = slot->next;
+					else if (free_tail < N)
+						slot = &slots[free_tail++];
+					else
+						return nullptr;
+
+					// Update statistics
+					if (++used > peak)
+						peak = used;
+
+					return new(slot->data) T(std::forward<Args>(args)...);
+				}
+
+				/// @brief Destruct and release an object
+				/// @param obj Object to release
+				/// @note No-operation if obj is null
+				void Release(T *obj)
+				{
+					if (obj == nullptr)
+						return;
+					obj->~T();
+
+					// Link slot to free list
+					Slot *slot = (Slot*)obj;
+					slot->next = free_head;
+					free_head = slot;
+					used--;
+				}
+
+				/// @brief Release all objects without destructing them
+				/// @note Only use this for trivially destructible types, or if the objects have already been destructed
+				void Reset()
+				{
+					free_head = nullptr;
+					free_tail = 0;
+					used = 0;
+				}
+
+				/// @brief Check if an object belongs to this pool
+				/// @param obj Object to check
+				/// @return `true` if the object is within this pool's storage
+				bool Contains(const T *obj) const
+				{
+					return (const char*)obj >= (const char*)&slots[0] && (const char*)obj < (const char*)&slots[N];
+				}
+
+				/// @brief Get pool capacity
+				/// @return Number of objects the pool can hold
+				static constexpr unsigned Capacity() { return N; }
+				/// @brief Get number of acquired objects
+				/// @return Number of acquired objects
+				unsigned Used() const { return used; }
+				/// @brief Get high-water mark
+				/// @return Largest number of objects that have been acquired at once
+				unsigned Peak() const { return peak; }
+				/// @brief Reset high-water mark to the current number of acquired objects
+				void ResetPeak() { peak = used; }
+		};
+	}
+}
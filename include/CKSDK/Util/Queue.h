@@ -115,6 +115,10 @@ namespace CKSDK
 					OS::EnableIRQ();
 				}
 
+				/// @brief Get queue length
+				/// @return Number of entries in the queue, including the running one
+				uint32_t Length() const { return queue_length; }
+
 				/// @brief Wait for queue to empty
 				void Sync()
 				{
@@ -32,6 +32,8 @@
 extern "C"
 {
 	extern uint8_t _end[];
+	extern uint8_t __kernel_free_start[];
+	extern uint8_t __kernel_free_end[];
 }
 
 namespace CKSDK
@@ -41,6 +43,13 @@ namespace CKSDK
 	{
 		// Initialize systems
 		Mem::Init(_end, 0x80200000 - uintptr_t(_end));
+		Mem::CreateHeap(__kernel_free_start, __kernel_free_end - __kernel_free_start, "Kernel");
+
+		size_t ram_size = OS::RamInstalled();
+		if (ram_size > 0x200000)
+			Mem::SetHeap(Mem::Tag_Asset, Mem::CreateHeap((void*)0x80200000, ram_size - 0x200000, "Expansion"));
+
+		Mem::Scratch::Init();
 		TTY::Init();
 
 		OS::Init();
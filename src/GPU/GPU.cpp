@@ -18,6 +18,7 @@
 #include <CKSDK/GPU.h>
 
 #include <CKSDK/OS.h>
+#include <CKSDK/Mem.h>
 #include <CKSDK/TTY.h>
 
 #include <CKSDK/Util/Queue.h>
@@ -33,19 +34,113 @@ namespace CKSDK
 		KEEP bool g_pal = false;
 
 		// GPU buffers
-		static Buffer buffers[2];
+		static Buffer buffers[BUFFER_MAX];
+		static size_t buffer_count = 2;
 		KEEP Buffer *g_bufferp;
 
+		static const char *layer_names[LAYER_MAX];
+
+		static Word *overflow_buffer;
+		static size_t overflow_size;
+
+		// Buffer statistics
+		static BufferStats buffer_stats;
+
+		// Frame profiler
+		// Times are taken from root counter 1, which Init sets to count scanlines
+		static FrameStats frame_stats[FRAME_STATS_MAX];
+		static uint32_t frame_stats_index;                    // Record of the frame being built
+		static FrameStats *frame_stats_buffer[BUFFER_MAX];    // Record of the frame in each buffer
+		static uint16_t frame_stats_flip[BUFFER_MAX];         // Time each buffer's frame was flipped
+		static FrameStats *volatile frame_stats_ot;           // Record of the frame whose OT is being read
+		static uint16_t frame_stats_ot_start;                 // Time the frame's OT started being read
+
+		static uint16_t frame_start; // Time the frame started being built
+		static uint16_t frame_wait;  // Time spent waiting while building and flipping the frame
+		static uint32_t frame_vblank; // Vblank counter at the last Flip
+
+		static uint16_t ProfileTime()
+		{
+			return OS::TimerCtrl(1).value;
+		}
+
+		static void ProfileOT(Buffer *bufferp)
+		{
+			// The frame's OT is about to start being read
+			unsigned i = bufferp - buffers;
+			FrameStats *record = frame_stats_buffer[i];
+			uint16_t now = ProfileTime();
+			frame_stats_ot_start = now;
+			if (record != nullptr)
+				record->gpu_start = now - frame_stats_flip[i];
+			frame_stats_ot = record;
+		}
+
+		static void RecordUsage(Buffer *bufferp)
+		{
+			size_t used = bufferp->Used();
+			FrameStats &record = frame_stats[frame_stats_index % FRAME_STATS_MAX];
+			record.packets = bufferp->packets;
+			record.words = used;
+
+			buffer_stats.used = used;
+			if (used > buffer_stats.peak)
+				buffer_stats.peak = used;
+			if (bufferp->spill != nullptr)
+				buffer_stats.overflows++;
+		}
+
+		static Buffer *NextBuffer(Buffer *bufferp)
+		{
+			return (++bufferp == &buffers[buffer_count]) ? &buffers[0] : bufferp;
+		}
+
 		// Callbacks
 		static FlipCallback flip_callback = nullptr;
 		static VBlankCallback vblank_callback = nullptr;
 		static QueueCallback queue_callback = nullptr;
 
+		// Asynchronous flip state
+		// Frames are counted as they're flipped, submitted, drawn and shown, and frame n is built in buffers[n % buffer_count]
+		static FlipMode flip_mode = FlipMode_Sync;
+
+		static volatile uint32_t frame_flipped;   // Frames flipped by the CPU
+		static volatile uint32_t frame_submitted; // Frames queued to the GPU
+		static volatile uint32_t frame_drawn;     // Frames whose OT has been read by the GPU
+		static volatile uint32_t frame_shown;     // Frames switched to by the display
+		static volatile bool frame_ot_dma;        // A frame's OT DMA is running
+
+		static void ResetFrames()
+		{
+			uint32_t frame = g_bufferp - buffers;
+			frame_flipped = frame;
+			frame_submitted = frame;
+			frame_drawn = frame;
+			frame_shown = frame;
+			frame_ot_dma = false;
+			frame_stats_ot = nullptr;
+		}
+
+		static void SubmitFrames();
+
 		// VBlank callback
 		static volatile uint32_t vblank_counter;
 
 		static void IRQ_VBlank()
 		{
+			// Display the next drawn frame
+			uint32_t frame = frame_shown;
+			if (frame != frame_drawn)
+			{
+				// Each buffer's display environment shows the previous buffer's framebuffer
+				GP1_Packet(buffers[(frame + 1) % buffer_count].display_environment);
+				GP1_Cmd((GP1_DisplayEnable << 24) | 0);
+
+				// Its framebuffer is now on screen, so the last one is free to be drawn to
+				frame_shown = frame + 1;
+				SubmitFrames();
+			}
+
 			// Call vblank callback
 			vblank_counter = vblank_counter + 1;
 			if (vblank_callback != nullptr)
@@ -57,11 +152,28 @@ namespace CKSDK
 		struct GPUQueueArgs
 		{
 			uint32_t arg[6];
+			TransferCallback cb;
 		};
-		static Queue::Queue<GPUQueueArgs, 16> gpu_queue;
+		static constexpr uint32_t GPU_QUEUE_SIZE = 16;
+		static Queue::Queue<GPUQueueArgs, GPU_QUEUE_SIZE> gpu_queue;
 
-		static void IRQ_DMA()
+		static TransferCallback transfer_callback; // Callback for the running transfer
+
+		static void PumpUploads();
+
+		static void DispatchQueue()
 		{
+			// Call the finished transfer's callback
+			if (transfer_callback != nullptr)
+			{
+				TransferCallback cb = transfer_callback;
+				transfer_callback = nullptr;
+				cb();
+			}
+
+			// Feed image loads to the queue before it's dispatched, so it isn't seen as empty
+			PumpUploads();
+
 			// Dispatch next draw queue command
 			if (gpu_queue.Dispatch())
 			{
@@ -72,6 +184,109 @@ namespace CKSDK
 			}
 		}
 
+		static void IRQ_DMA()
+		{
+			// Check if this was a profiled OT finishing
+			if (FrameStats *record = frame_stats_ot)
+			{
+				uint16_t gpu = ProfileTime() - frame_stats_ot_start;
+				record->gpu = (gpu != 0) ? gpu : 1;
+				frame_stats_ot = nullptr;
+			}
+
+			// Check if this was a frame's OT finishing
+			if (frame_ot_dma)
+			{
+				// The CPU can now reuse the buffer
+				frame_ot_dma = false;
+				frame_drawn = frame_drawn + 1;
+			}
+			DispatchQueue();
+		}
+
+		static void IRQ_GPU()
+		{
+			// Raised by GP0_IRQ after a VRAM copy
+			GP1_Cmd(GP1_AckIRQ << 24);
+			DispatchQueue();
+		}
+
+		// Image loads
+		// Loads wait here until the queue has room and the frame's budget allows, then are fed to it a band of rows at a time
+		struct Upload
+		{
+			const uint8_t *addr;
+			uint16_t x, y, w, h;
+		};
+
+		static constexpr uint32_t UPLOAD_QUEUE_RESERVE = 4; // Queue entries left free for other commands
+
+		static Upload uploads[UPLOAD_MAX];
+		static volatile size_t upload_head, upload_count;
+		static size_t upload_budget, upload_left;
+
+		// Ordering table clear
+		// The OTC DMA runs alongside the CPU, and the DMA IRQ chains it through each layer
+		static Buffer *volatile ot_clear_buffer; // Buffer being cleared
+		static volatile Layer ot_clear_layer;    // Layer being cleared
+
+		static void StartClear(Buffer *bufferp, Layer layer)
+		{
+			OS::DmaCtrl(OS::DMA::OTC).madr = uint32_t(&bufferp->GetOT(layer, bufferp->layer_size[layer] - 1));
+			OS::DmaCtrl(OS::DMA::OTC).bcr  = (bufferp->layer_size[layer] + 1) & 0xFFFF;
+			OS::DmaCtrl(OS::DMA::OTC).chcr = 0x11000002;
+		}
+
+		static void IRQ_OTC()
+		{
+			Buffer *bufferp = ot_clear_buffer;
+			if (bufferp == nullptr)
+				return;
+
+			// Clear the next layer
+			Layer layer = ot_clear_layer + 1;
+			if (layer < bufferp->layer_count)
+			{
+				ot_clear_layer = layer;
+				StartClear(bufferp, layer);
+				return;
+			}
+
+			// Let AllocPacket use the buffer
+			bufferp->prie = bufferp->buffer_end;
+			ot_clear_buffer = nullptr;
+		}
+
+		// Draw environment stack
+		// Environments pushed while building the frame, on top of the buffer's own
+		static DrawEnvironment draw_stack[DRAW_STACK_MAX];
+		static size_t draw_stack_depth;
+
+		static void ClearOT(Buffer *bufferp)
+		{
+			// Wait for the last clear
+			OTSync();
+
+			// Reset the primitive buffer, but hold its end at its start so AllocPacket waits for the clear
+			bufferp->prip = bufferp->Packets();
+			bufferp->prie = bufferp->prip;
+			bufferp->spill = nullptr;
+			bufferp->layer_used = 0;
+			bufferp->packets = 0;
+			draw_stack_depth = 0;
+
+			// Start clearing the first layer
+			ot_clear_layer = 0;
+			ot_clear_buffer = bufferp;
+			StartClear(bufferp, 0);
+		}
+
+		KEEP void OTSync()
+		{
+			// Wait for the ordering table clear to finish
+			while (ot_clear_buffer != nullptr);
+		}
+
 		// GPU functions
 		KEEP void Init()
 		{
@@ -87,7 +302,9 @@ namespace CKSDK
 			
 			// Setup IRQ
 			OS::SetIRQ(OS::IRQ::VBLANK, IRQ_VBlank);
+			OS::SetIRQ(OS::IRQ::GPU, IRQ_GPU);
 			OS::SetDMA(OS::DMA::GPU, IRQ_DMA);
+			OS::SetDMA(OS::DMA::OTC, IRQ_OTC);
 
 			// Enable DMA2 and DMA6
 			OS::DmaDpcr() = OS::DpcrSet(OS::DpcrSet(OS::DmaDpcr(), OS::DMA::GPU, 3), OS::DMA::OTC, 3);
@@ -98,6 +315,12 @@ namespace CKSDK
 			GP1_Cmd(GP1_Reset << 24);
 			GP1_Cmd(GP1_Flush << 24);
 
+			// Drop pending image loads, and any frames in flight as the reset stops them reaching the display
+			flip_mode = FlipMode_Sync;
+			upload_count = 0;
+			upload_budget = 0;
+			transfer_callback = nullptr;
+
 			OS::TimerCtrl(0).ctrl = 0x0500;
 			OS::TimerCtrl(1).ctrl = 0x0500;
 
@@ -151,33 +374,110 @@ namespace CKSDK
 			OS::EnableIRQ();
 		}
 
-		KEEP void SetBuffer(Word *buffer, size_t size, size_t ot_size)
+		KEEP void SetBuffer(Word *buffer, size_t size, size_t ot_size, size_t count)
+		{
+			// Use a single unnamed layer
+			LayerConfig layer = {nullptr, ot_size};
+			SetBuffer(buffer, size, &layer, 1, count);
+		}
+
+		KEEP void SetBuffer(Word *buffer, size_t size, const LayerConfig *layers, Layer layer_count, size_t count)
 		{
+			if (count < 2 || count > BUFFER_MAX)
+				ExScreen::Abort("Invalid buffer count for SetBuffer");
+			if (layer_count < 1 || layer_count > LAYER_MAX)
+				ExScreen::Abort("Invalid layer count for SetBuffer");
+
+			// Let any frames in flight finish with the old buffers
+			if (flip_mode == FlipMode_Async)
+				while (frame_shown != frame_flipped);
+			QueueSync();
+
+			// Each layer's ordering table has its entries and a terminator
+			size_t ot_words = 0;
+			for (Layer i = 0; i < layer_count; i++)
+			{
+				if (layers[i].ot_size == 0)
+					ExScreen::Abort("Invalid layer size for SetBuffer");
+				layer_names[i] = layers[i].name;
+				ot_words += layers[i].ot_size + 1;
+			}
+			
 			// Setup buffers
 			Word *bufferp = buffer;
-			size >>= 1;
-			for (auto &i : buffers)
+			size /= count;
+			if (size <= ot_words)
+				ExScreen::Abort("GPU buffer too small for ordering table");
+
+			for (size_t i = 0; i < count; i++)
 			{
-				i.buffer = bufferp;
-				i.ot_size = ot_size;
+				Buffer &buf = buffers[i];
+				buf.buffer = bufferp;
+				buf.ot_size = layers[0].ot_size;
+
+				buf.layer_count = layer_count;
+				Word *otp = bufferp;
+				for (Layer j = 0; j < layer_count; j++)
+				{
+					buf.layer_ot[j] = otp;
+					buf.layer_size[j] = layers[j].ot_size;
+					otp += layers[j].ot_size + 1;
+				}
+
 				bufferp += size;
+				buf.buffer_end = bufferp;
 			}
+			buffer_count = count;
+
+			buffer_stats = {};
+			buffer_stats.size = size - ot_words;
+			SetOverflowBuffer(overflow_buffer, overflow_size);
 
 			// Initialize buffers
 			g_bufferp = &buffers[0];
-			g_bufferp->Init();
+			ClearOT(g_bufferp);
+			ResetFrames();
+		}
+
+		KEEP Layer FindLayer(const char *name)
+		{
+			for (Layer i = 0; i < buffers[0].layer_count; i++)
+			{
+				if (layer_names[i] != nullptr && __builtin_strcmp(layer_names[i], name) == 0)
+					return i;
+			}
+			return LAYER_NONE;
 		}
 
 		KEEP void SetScreen(uint32_t w, uint32_t h, uint32_t ox, uint32_t oy, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
 		{
+			// Alternate between the two framebuffers, with more buffers one would be shown while it's drawn to
+			if (buffer_count > 2)
+				ExScreen::Abort("SetScreen with two framebuffers needs two buffers");
+			ScreenCoord framebuffers[BUFFER_MAX];
+			for (size_t i = 0; i < BUFFER_MAX; i++)
+				framebuffers[i] = (i & 1) ? ScreenCoord(x1, y1) : ScreenCoord(x0, y0);
+			SetScreen(w, h, ox, oy, framebuffers);
+		}
+
+		KEEP void SetScreen(uint32_t w, uint32_t h, uint32_t ox, uint32_t oy, const ScreenCoord *framebuffers)
+		{
+			// Let any frames in flight reach the display before the frame counters are reset
+			if (flip_mode == FlipMode_Async)
+				while (frame_shown != frame_flipped);
+			QueueSync();
+
 			// Set buffer framebuffer commands
 			g_bufferp = &buffers[0];
+			ResetFrames();
 
-			buffers[0].draw_environment = DrawEnvironment(x0, y0, w, h, ox, oy);
-			buffers[0].display_environment = DisplayEnvironment(x1, y1, w, h);
-
-			buffers[1].draw_environment = DrawEnvironment(x0, y0, w, h, ox, oy);
-			buffers[1].display_environment = DisplayEnvironment(x0, y0, w, h);
+			for (size_t i = 0; i < buffer_count; i++)
+			{
+				const ScreenCoord &draw = framebuffers[i];
+				const ScreenCoord &display = framebuffers[(i != 0) ? (i - 1) : (buffer_count - 1)];
+				buffers[i].draw_environment = DrawEnvironment(draw.s.x, draw.s.y, w, h, ox, oy);
+				buffers[i].display_environment = DisplayEnvironment(display.s.x, display.s.y, w, h);
+			}
 
 			// Setup mode
 			uint32_t mode = (GP1_DisplayMode << 24);
@@ -249,11 +549,334 @@ namespace CKSDK
 			}
 		}
 
+		KEEP size_t GetFramebuffers(Rect *rects)
+		{
+			// Decode the draw area of each buffer, skipping those SetScreen hasn't set up
+			size_t count = 0;
+			for (size_t i = 0; i < buffer_count; i++)
+			{
+				const DrawEnvironment &env = buffers[i].draw_environment;
+				if ((env.tl >> 24) != GP0_DrawTL)
+					continue;
+
+				int16_t x = (env.tl >> 0) & 0x3FF, y = (env.tl >> 10) & 0x1FF;
+				Rect &rect = rects[count++];
+				rect.x = x;
+				rect.y = y;
+				rect.w = ((env.br >> 0) & 0x3FF) - x + 1;
+				rect.h = ((env.br >> 10) & 0x1FF) - y + 1;
+			}
+			return count;
+		}
+
+		KEEP void SetOverflowBuffer(Word *buffer, size_t size)
+		{
+			// Setup overflow pages
+			overflow_buffer = buffer;
+			overflow_size = (buffer == nullptr) ? 0 : size;
+
+			Word *bufferp = buffer;
+			size = overflow_size / buffer_count;
+			for (size_t i = 0; i < buffer_count; i++)
+			{
+				buffers[i].overflow = bufferp;
+				if (bufferp != nullptr)
+					bufferp += size;
+				buffers[i].overflow_end = bufferp;
+			}
+			buffer_stats.overflow_size = size;
+		}
+
+		KEEP void GetBufferStats(BufferStats *stats)
+		{
+			*stats = buffer_stats;
+		}
+
+		KEEP void ResetBufferPeak()
+		{
+			buffer_stats.peak = buffer_stats.used;
+			buffer_stats.overflows = 0;
+		}
+
+		KEEP const FrameStats &GetFrameStats(size_t ago)
+		{
+			return frame_stats[(frame_stats_index - 1 - ago) % FRAME_STATS_MAX];
+		}
+
+		KEEP void DrawFrameStats(Layer layer, size_t ot, int16_t x, int16_t y)
+		{
+			// Graph constants
+			static constexpr unsigned COLUMN_WIDTH = 3;
+			static constexpr unsigned LINE_SHIFT = 2;
+
+			// Mark a whole frame
+			unsigned frame_lines = g_pal ? 312 : 262;
+			FillPrim<> &line = AllocPacket<FillPrim<>>(layer, ot);
+			line.c = Color(0xFF, 0xFF, 0xFF);
+			line.xy = ScreenCoord(x, y - (frame_lines >> LINE_SHIFT));
+			line.wh = ScreenDim(FRAME_STATS_MAX * COLUMN_WIDTH, 1);
+
+			// Draw a column for each frame, oldest on the left
+			for (size_t i = 0; i < FRAME_STATS_MAX; i++)
+			{
+				const FrameStats &record = GetFrameStats(FRAME_STATS_MAX - 1 - i);
+				int16_t cx = x + i * COLUMN_WIDTH;
+				uint16_t cpu = (record.cpu + record.flip) >> LINE_SHIFT;
+				uint16_t wait = record.wait >> LINE_SHIFT;
+				uint16_t gpu = record.gpu >> LINE_SHIFT;
+
+				// Waiting is drawn over the CPU time it's part of
+				FillPrim<> *bars = (FillPrim<>*)AllocPacket(layer, ot, 3 * (sizeof(FillPrim<>) / sizeof(Word)));
+				new(&bars[0]) FillPrim<>();
+				bars[0].c = Color(0x00, 0xC0, 0x00);
+				bars[0].xy = ScreenCoord(cx, y - cpu);
+				bars[0].wh = ScreenDim(COLUMN_WIDTH - 1, cpu);
+
+				new(&bars[1]) FillPrim<>();
+				bars[1].c = Color(0xC0, 0x00, 0x00);
+				bars[1].xy = ScreenCoord(cx, y - wait);
+				bars[1].wh = ScreenDim(COLUMN_WIDTH - 1, wait);
+
+				new(&bars[2]) FillPrim<>();
+				bars[2].c = Color(0x40, 0x40, 0xFF);
+				bars[2].xy = ScreenCoord(cx + COLUMN_WIDTH - 1, y - gpu);
+				bars[2].wh = ScreenDim(1, gpu);
+			}
+		}
+
+		static void OutFrameStat(const char *label, uint32_t (*get)(const FrameStats&))
+		{
+			// Average and maximum over the recorded frames, leaving out the last one which the GPU may not have finished
+			size_t count = (frame_stats_index < FRAME_STATS_MAX) ? frame_stats_index : FRAME_STATS_MAX;
+			uint32_t total = 0, max = 0;
+			for (size_t i = 1; i < count; i++)
+			{
+				uint32_t value = get(GetFrameStats(i));
+				total += value;
+				if (value > max)
+					max = value;
+			}
+
+			TTY::Out(label);
+			TTY::OutHex<4>((count > 1) ? (total / (count - 1)) : 0);
+			TTY::Out("/");
+			TTY::OutHex<4>(max);
+		}
+
+		KEEP void DumpFrameStats()
+		{
+			// Output statistics
+			TTY::Out("GPU frame stats (average/max)");
+			OutFrameStat("\n cpu ", [](const FrameStats &i) -> uint32_t { return i.cpu; });
+			OutFrameStat(" flip ", [](const FrameStats &i) -> uint32_t { return i.flip; });
+			OutFrameStat(" wait ", [](const FrameStats &i) -> uint32_t { return i.wait; });
+			OutFrameStat("\n gpu start ", [](const FrameStats &i) -> uint32_t { return i.gpu_start; });
+			OutFrameStat(" gpu ", [](const FrameStats &i) -> uint32_t { return i.gpu; });
+			OutFrameStat("\n packets ", [](const FrameStats &i) -> uint32_t { return i.packets; });
+			OutFrameStat(" words ", [](const FrameStats &i) -> uint32_t { return i.words; });
+			OutFrameStat(" dropped ", [](const FrameStats &i) -> uint32_t { return i.dropped; });
+			TTY::Out("\n");
+		}
+
+		KEEP Word *AllocOverflow(size_t words)
+		{
+			// Wait for the ordering tables to be cleared, the packet may fit now
+			Buffer *bufferp = g_bufferp;
+			if (ot_clear_buffer == bufferp)
+			{
+				OTSync();
+				if (size_t(bufferp->prie - bufferp->prip) >= words)
+					return bufferp->prip;
+			}
+
+			// Move to the overflow page if we haven't already
+			if (bufferp->spill == nullptr && size_t(bufferp->overflow_end - bufferp->overflow) >= words)
+			{
+				bufferp->spill = bufferp->prip;
+				bufferp->prip = bufferp->overflow;
+				bufferp->prie = bufferp->overflow_end;
+				return bufferp->prip;
+			}
+
+			ExScreen::Abort("GPU packet buffer overflow");
+			return nullptr;
+		}
+
+		static void FlipUploads()
+		{
+			if (upload_budget == 0)
+			{
+				// Wait for every load to be queued, so they finish before the frame's ordering table
+				while (upload_count != 0);
+				return;
+			}
+
+			// Start a new frame's budget
+			OS::DisableIRQ();
+			upload_left = upload_budget;
+			PumpUploads();
+			OS::EnableIRQ();
+		}
+
+		static const DrawEnvironment &CurrentDrawEnvironment()
+		{
+			return (draw_stack_depth != 0) ? draw_stack[draw_stack_depth - 1] : g_bufferp->draw_environment;
+		}
+
+		static void LinkDrawEnvironment(Layer layer, size_t ot, const DrawEnvironment &env, bool flush)
+		{
+			// Flush the texture cache first if the area drawn to is going to be sampled
+			Word *packetp = AllocPacket(layer, ot, flush ? 4 : 3);
+			if (flush)
+				*packetp++ = GP0_FlushCache << 24;
+			packetp[0] = env.tl;
+			packetp[1] = env.br;
+			packetp[2] = env.off;
+		}
+
+		KEEP void PushDrawEnvironment(Layer layer, size_t ot, const DrawEnvironment &env)
+		{
+			if (draw_stack_depth >= DRAW_STACK_MAX)
+				ExScreen::Abort("Draw environment stack overflow");
+			draw_stack[draw_stack_depth++] = env;
+			LinkDrawEnvironment(layer, ot, env, false);
+		}
+
+		KEEP void PushClip(Layer layer, size_t ot, const Rect &rect)
+		{
+			// Decode the current area and offset, the offset being signed 11-bit
+			const DrawEnvironment &cur = CurrentDrawEnvironment();
+			int32_t left = (cur.tl >> 0) & 0x3FF, top = (cur.tl >> 10) & 0x1FF;
+			int32_t right = (cur.br >> 0) & 0x3FF, bottom = (cur.br >> 10) & 0x1FF;
+			int32_t ox = int32_t(cur.off << 21) >> 21;
+			int32_t oy = int32_t(cur.off << 10) >> 21;
+
+			// Clip the rectangle to the current area
+			int32_t x0 = ox + rect.x, y0 = oy + rect.y;
+			int32_t x1 = x0 + rect.w - 1, y1 = y0 + rect.h - 1;
+			if (x0 < left)
+				x0 = left;
+			if (y0 < top)
+				y0 = top;
+			if (x1 > right)
+				x1 = right;
+			if (y1 > bottom)
+				y1 = bottom;
+
+			// An area with its bottom right above its top left draws nothing
+			if (x1 < x0 || y1 < y0)
+			{
+				x0 = y0 = 1;
+				x1 = y1 = 0;
+			}
+
+			DrawEnvironment env;
+			env.tl = (GP0_DrawTL << 24) | (x0 << 0) | (y0 << 10);
+			env.br = (GP0_DrawBR << 24) | (x1 << 0) | (y1 << 10);
+			env.off = cur.off;
+			PushDrawEnvironment(layer, ot, env);
+		}
+
+		KEEP void PopDrawEnvironment(Layer layer, size_t ot)
+		{
+			if (draw_stack_depth == 0)
+				ExScreen::Abort("Draw environment stack underflow");
+			draw_stack_depth--;
+			LinkDrawEnvironment(layer, ot, CurrentDrawEnvironment(), true);
+		}
+
+		static void ProfileBegin(Buffer *bufferp)
+		{
+			// Start the frame's record
+			FrameStats &record = frame_stats[frame_stats_index % FRAME_STATS_MAX];
+			uint16_t now = ProfileTime();
+			record.cpu = now - frame_start;
+			record.gpu_start = 0;
+			record.gpu = 0;
+
+			if (frame_stats_index == 0)
+				frame_vblank = vblank_counter - 1;
+			uint32_t vblanks = vblank_counter - frame_vblank;
+			frame_vblank += vblanks;
+			vblanks = (vblanks != 0) ? (vblanks - 1) : 0;
+			record.dropped = (vblanks < 0xFFFF) ? vblanks : 0xFFFF;
+
+			unsigned i = bufferp - buffers;
+			frame_stats_buffer[i] = &record;
+			frame_stats_flip[i] = now;
+		}
+
+		static void ProfileEnd(Buffer *bufferp)
+		{
+			// Finish the frame's record and start timing the next frame
+			FrameStats &record = frame_stats[frame_stats_index % FRAME_STATS_MAX];
+			uint16_t now = ProfileTime();
+			record.flip = now - frame_stats_flip[bufferp - buffers];
+			record.wait = frame_wait;
+
+			frame_wait = 0;
+			frame_start = now;
+			frame_stats_index++;
+		}
+
+		static void Flip_Async()
+		{
+			// Call flip callback
+			if (flip_callback != nullptr)
+				flip_callback();
+			RecordUsage(g_bufferp);
+
+			// The ordering tables must be cleared before they're linked, even if nothing was drawn
+			OTSync();
+
+			// Let the frame's image loads through first
+			FlipUploads();
+
+			// Submit frame
+			// It's drawn once its framebuffer is neither on screen nor waiting to be shown
+			OS::DisableIRQ();
+
+			uint32_t frame = frame_flipped + 1;
+			frame_flipped = frame;
+			SubmitFrames();
+
+			OS::EnableIRQ();
+
+			// Wait for the GPU to finish reading the OT of the buffer we're flipping to
+			// The frame arena is only split in two, so it limits how far ahead we can get when in use
+			uint32_t depth = buffer_count;
+			size_t arena_size;
+			Mem::FrameArena::Profile(nullptr, &arena_size);
+			if (arena_size != 0 && depth > 2)
+				depth = 2;
+
+			uint16_t wait = ProfileTime();
+			while ((frame - frame_drawn) >= depth);
+			frame_wait += ProfileTime() - wait;
+
+			// Flip and initialize buffer
+			Buffer *bufferp = &buffers[frame % buffer_count];
+			g_bufferp = bufferp;
+			ClearOT(bufferp);
+
+			// Flip frame arena along with the buffers
+			Mem::FrameArena::Flip();
+		}
+
 		KEEP void Flip()
 		{
 			Buffer *bufferp = g_bufferp;
+			ProfileBegin(bufferp);
+
+			if (flip_mode == FlipMode_Async)
+			{
+				Flip_Async();
+				ProfileEnd(bufferp);
+				return;
+			}
 
 			// Sync
+			FlipUploads();
 			QueueSync();
 			VBlankSync();
 			
@@ -265,28 +888,57 @@ namespace CKSDK
 			// Call flip callback
 			if (flip_callback != nullptr)
 				flip_callback();
+			RecordUsage(bufferp);
 
 			// Send GP0 setup packet
 			// These commands are not safe to send during the OT, so we send them here
 			GP0_Packet(bufferp->draw_environment);
 
 			// Send OT to GPU
-			Queue_OrderingTableDMA(bufferp->GetOT(bufferp->ot_size - 1));
+			// The ordering tables must be cleared before they're linked, even if nothing was drawn
+			OTSync();
+			ProfileOT(bufferp);
+			Queue_OrderingTableDMA(bufferp->Link());
 
 			// Flip and initialize buffer
-			bufferp = (bufferp == &buffers[0]) ? &buffers[1] : &buffers[0];
+			ProfileEnd(bufferp);
+			bufferp = NextBuffer(bufferp);
 			g_bufferp = bufferp;
-			bufferp->Init();
+			ClearOT(bufferp);
+
+			// Flip frame arena along with the buffers
+			Mem::FrameArena::Flip();
+		}
+		
+		KEEP FlipMode SetFlipMode(FlipMode mode)
+		{
+			// Let any frames in flight reach the display
+			if (flip_mode == FlipMode_Async)
+				while (frame_shown != frame_flipped);
+			QueueSync();
+
+			FlipMode old_mode = flip_mode;
+			flip_mode = mode;
+			ResetFrames();
+			return old_mode;
+		}
+		KEEP FlipMode GetFlipMode()
+		{
+			return flip_mode;
 		}
 		
 		KEEP void VBlankSync()
 		{
 			// Wait for vblank
+			uint16_t wait = ProfileTime();
 			uint32_t counter = vblank_counter;
 			for (unsigned i = VSYNC_TIMEOUT; i != 0; i--)
 			{
 				if (counter != vblank_counter)
+				{
+					frame_wait += ProfileTime() - wait;
 					return;
+				}
 			}
 
 			TTY::Out("GPU vsync timeout\n");
@@ -301,6 +953,7 @@ namespace CKSDK
 			uint32_t wh = args.arg[2];
 			uint32_t bcr = args.arg[3];
 			uint32_t write = args.arg[4];
+			transfer_callback = args.cb;
 
 			// Disable DMA
 			DataSync();
@@ -309,7 +962,7 @@ namespace CKSDK
 			GP0_Cmd(GP0_FlushCache << 24);
 
 			// Set DMA command
-			GP0_Cmd(write ? (GP0_ToVRAM << 24) : (GP0_FrVRAM << 24));
+			GP0_Cmd(write ? (GP0_ToVRAM << 24) : (GP0_ToCPU << 24));
 			GP0_Data(xy);
 			GP0_Data(wh);
 			// DataSync();
@@ -325,6 +978,46 @@ namespace CKSDK
 			return false;
 		}
 
+		static bool Command_VRAMCopy(const GPUQueueArgs &args)
+		{
+			// Get arguments
+			uint32_t src = args.arg[0];
+			uint32_t dst = args.arg[1];
+			uint32_t wh = args.arg[2];
+			transfer_callback = args.cb;
+
+			// Send copy command, then have the GPU tell us when it's done
+			DataSync();
+			GP1_Cmd((GP1_DMADirection << 24) | 0);
+
+			GP0_Cmd(GP0_FlushCache << 24);
+			GP0_Cmd(GP0_FrVRAM << 24);
+			GP0_Data(src);
+			GP0_Data(dst);
+			GP0_Data(wh);
+			GP0_Cmd(GP0_IRQ << 24);
+
+			return false;
+		}
+
+		static bool Command_CommandDMA(const GPUQueueArgs &args)
+		{
+			// Get arguments
+			uint32_t addr = args.arg[0];
+			uint32_t bcr = args.arg[1];
+
+			// Set DMA direction
+			DataSync();
+			GP1_Cmd((GP1_DMADirection << 24) | 2);
+
+			// Start DMA
+			OS::DmaCtrl(OS::DMA::GPU).madr = addr;
+			OS::DmaCtrl(OS::DMA::GPU).bcr = bcr;
+			OS::DmaCtrl(OS::DMA::GPU).chcr = 0x01000201;
+
+			return false;
+		}
+
 		static bool Command_OrderingTableDMA(const GPUQueueArgs &args)
 		{
 			// Get arguments
@@ -347,6 +1040,39 @@ namespace CKSDK
 			return false;
 		}
 
+		static bool Command_FrameDMA(const GPUQueueArgs &args)
+		{
+			// Get arguments
+			Buffer *bufferp = reinterpret_cast<Buffer*>(args.arg[0]);
+
+			// Send GP0 setup packet
+			// These commands are not safe to send during the OT, so we send them here
+			DataSync();
+			GP1_Cmd((GP1_DMADirection << 24) | 0);
+			GP0_Packet(bufferp->draw_environment);
+
+			// Send OT to GPU
+			frame_ot_dma = true;
+			ProfileOT(bufferp);
+			return Command_OrderingTableDMA(GPUQueueArgs{
+				reinterpret_cast<uint32_t>(&bufferp->Link())
+			});
+		}
+
+		static void SubmitFrames()
+		{
+			// Frame n draws to the framebuffer shown by frame n - buffer_count, so it has to wait until the frame after that is shown
+			// Must be called with IRQs disabled
+			uint32_t frame = frame_submitted;
+			while (frame != frame_flipped && (frame - frame_shown) < (buffer_count - 1))
+			{
+				gpu_queue.Enqueue(Command_FrameDMA, GPUQueueArgs{
+					reinterpret_cast<uint32_t>(&buffers[frame % buffer_count])
+				});
+				frame_submitted = ++frame;
+			}
+		}
+
 		static bool Command_GP1(const GPUQueueArgs &args)
 		{
 			// Get arguments
@@ -362,18 +1088,23 @@ namespace CKSDK
 		KEEP void QueueSync()
 		{
 			// Wait for queue to clear up
+			uint16_t wait = ProfileTime();
 			gpu_queue.Sync();
 
 			// Sync
 			CHCRSync();
 			CmdSync();
 			DataSync();
+			frame_wait += ProfileTime() - wait;
 		}
 
 		KEEP void QueueReset()
 		{
-			// Drop all queued commands
+			// Drop all queued commands and pending loads
+			OS::DisableIRQ();
 			gpu_queue.Reset();
+			upload_count = 0;
+			OS::EnableIRQ();
 		}
 
 		KEEP void Queue_OrderingTableDMA(const Tag &buffer)
@@ -390,6 +1121,200 @@ namespace CKSDK
 			});
 		}
 
+		static uint32_t ImageBCR(size_t words)
+		{
+			// Use the largest block size that divides the transfer, up to the FIFO size
+			uint32_t bs = 1;
+			while (((words & 1) == 0) && (bs < GP0_FIFO_WORDS))
+			{
+				bs <<= 1;
+				words >>= 1;
+			}
+			if (words >= 0x10000)
+				ExScreen::Abort("Image DMA too large");
+			return (words << 16) | bs;
+		}
+
+		static void PumpUploads()
+		{
+			// Must be called with IRQs disabled
+			while (upload_count != 0 && gpu_queue.Length() < (GPU_QUEUE_SIZE - UPLOAD_QUEUE_RESERVE))
+			{
+				Upload &upload = uploads[upload_head];
+
+				// Take as many rows as fit in a chunk and what's left of the budget, but at least one band per frame
+				size_t row_size = upload.w * 2;
+				size_t size = UPLOAD_CHUNK_SIZE;
+				if (upload_budget != 0)
+				{
+					if (upload_left < row_size && upload_left != upload_budget)
+						break;
+					if (upload_left < size)
+						size = upload_left;
+				}
+
+				uint32_t rows = size / row_size;
+				if (rows == 0)
+					rows = 1;
+				if (rows >= upload.h)
+				{
+					rows = upload.h;
+				}
+				else if (upload.w & 1)
+				{
+					// An odd number of pixels is padded to a word, so bands have to be an even number of rows to keep the next one aligned
+					rows = (rows + 1) & ~1;
+					if (rows > upload.h)
+						rows = upload.h;
+				}
+
+				// Bands are small enough that the block count fits even if it's one word per block
+				size_t pixels = size_t(upload.w) * rows;
+				gpu_queue.Enqueue(Command_ImageDMA, GPUQueueArgs{
+					uint32_t(upload.addr), uint32_t(upload.x) | (uint32_t(upload.y) << 16), uint32_t(upload.w) | (rows << 16), ImageBCR((pixels + 1) >> 1), 1
+				});
+
+				// Move to the next band
+				size = pixels * 2;
+				if (upload_budget != 0)
+					upload_left = (size < upload_left) ? (upload_left - size) : 0;
+
+				upload.addr += size;
+				upload.y += rows;
+				upload.h -= rows;
+				if (upload.h == 0)
+				{
+					upload_head = (upload_head + 1) % UPLOAD_MAX;
+					upload_count = upload_count - 1;
+				}
+			}
+		}
+
+		KEEP void Queue_ImageLoad(const void *addr, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+		{
+			if (w == 0 || h == 0)
+				return;
+
+			OS::DisableIRQ();
+
+			// Without a budget, loads are always moving, so wait for one to be queued
+			if (upload_count >= UPLOAD_MAX)
+			{
+				if (upload_budget != 0)
+					ExScreen::Abort("Image load queue overflow");
+				OS::EnableIRQ();
+				while (upload_count >= UPLOAD_MAX);
+				OS::DisableIRQ();
+			}
+
+			// Add load to the end
+			Upload &upload = uploads[(upload_head + upload_count) % UPLOAD_MAX];
+			upload.addr = (const uint8_t*)addr;
+			upload.x = x;
+			upload.y = y;
+			upload.w = w;
+			upload.h = h;
+			upload_count = upload_count + 1;
+
+			PumpUploads();
+
+			OS::EnableIRQ();
+		}
+
+		static constexpr size_t STORE_BAND_WORDS = 0xFFFF; // Most words one band of a store can read, so the block count fits even at one word per block
+
+		KEEP void Queue_ImageStore(void *addr, uint16_t x, uint16_t y, uint16_t w, uint16_t h, TransferCallback cb)
+		{
+			if (w == 0 || h == 0)
+			{
+				// Nothing to read
+				if (cb != nullptr)
+					cb();
+				return;
+			}
+
+			// Read in bands of as many rows as fit, an odd width needs an even number of rows to keep the next band aligned
+			uint32_t band = (STORE_BAND_WORDS * 2) / w;
+			if (w & 1)
+				band &= ~1;
+
+			// Wait for room for every band, loads and frames may be holding most of the queue
+			uint32_t bands = (h + band - 1) / band;
+			OS::DisableIRQ();
+			while ((GPU_QUEUE_SIZE - gpu_queue.Length()) < bands)
+			{
+				OS::EnableIRQ();
+				OS::DisableIRQ();
+			}
+
+			// Keep the bands together in the queue, the callback is only given to the last one
+			uint8_t *addrp = (uint8_t*)addr;
+			while (h != 0)
+			{
+				uint32_t rows = (band < h) ? band : h;
+				size_t pixels = size_t(w) * rows;
+				h -= rows;
+
+				gpu_queue.Enqueue(Command_ImageDMA, GPUQueueArgs{
+					{uint32_t(addrp), uint32_t(x) | (uint32_t(y) << 16), uint32_t(w) | (rows << 16), ImageBCR((pixels + 1) >> 1), 0},
+					(h == 0) ? cb : TransferCallback()
+				});
+
+				addrp += pixels * 2;
+				y += rows;
+			}
+			OS::EnableIRQ();
+		}
+
+		KEEP void Queue_VRAMCopy(uint16_t sx, uint16_t sy, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h, TransferCallback cb)
+		{
+			gpu_queue.Enqueue(Command_VRAMCopy, GPUQueueArgs{
+				{uint32_t(sx) | (uint32_t(sy) << 16), uint32_t(dx) | (uint32_t(dy) << 16), uint32_t(w) | (uint32_t(h) << 16)},
+				cb
+			});
+		}
+
+		KEEP size_t SetUploadBudget(size_t bytes)
+		{
+			size_t old_budget = upload_budget;
+			OS::DisableIRQ();
+			upload_budget = bytes;
+			upload_left = bytes;
+			PumpUploads();
+			OS::EnableIRQ();
+			return old_budget;
+		}
+
+		KEEP size_t UploadsPending()
+		{
+			return upload_count;
+		}
+
+		static constexpr size_t COMMAND_CHUNK_WORDS = 0xFFFF * GP0_FIFO_WORDS; // Most words one command DMA can send
+
+		KEEP void Queue_CommandDMA(const Word *addr, size_t words)
+		{
+			// Keep the chunks together in the queue, GP0 doesn't care where a DMA ends
+			OS::DisableIRQ();
+			while (words != 0)
+			{
+				// A chunk this big only fits the block count with full blocks, so send the odd words after it
+				size_t chunk = words;
+				if (chunk > COMMAND_CHUNK_WORDS)
+					chunk = COMMAND_CHUNK_WORDS;
+				else if (chunk >= 0x10000)
+					chunk &= ~size_t(GP0_FIFO_WORDS - 1);
+
+				gpu_queue.Enqueue(Command_CommandDMA, GPUQueueArgs{
+					uint32_t(addr), ImageBCR(chunk)
+				});
+
+				addr += chunk;
+				words -= chunk;
+			}
+			OS::EnableIRQ();
+		}
+
 		KEEP void Queue_GP1(const Word *addr, size_t size)
 		{
 			gpu_queue.Enqueue(Command_GP1, GPUQueueArgs{
@@ -397,6 +1322,93 @@ namespace CKSDK
 			});
 		}
 
+		// Display lists
+		KEEP void DisplayList::Begin(Word *buffer, size_t size)
+		{
+			base = buffer;
+			end = buffer + size;
+			prip = buffer;
+			last = nullptr;
+			words = 0;
+			copies = 1;
+		}
+
+		KEEP Word *DisplayList::Alloc(size_t size)
+		{
+			// Check if there's space for the packet
+			Word *packetp = prip;
+			Word *next = packetp + size + 1;
+			if (next > end)
+			{
+				ExScreen::Abort("DisplayList overflow");
+				return nullptr;
+			}
+
+			// Link previous packet to this one
+			if (last != nullptr)
+				new(last) Tag(packetp, ((Tag*)last)->Words());
+			new(packetp) Tag(uintptr_t(0xFFFFFF), size);
+
+			last = packetp;
+			prip = next;
+			return packetp + 1;
+		}
+
+		KEEP void DisplayList::End()
+		{
+			if (last == nullptr)
+				ExScreen::Abort("DisplayList is empty");
+
+			// Check if there's space for a copy per buffer
+			words = prip - base;
+			copies = buffer_count;
+			if (size_t(end - base) < (words * copies))
+			{
+				ExScreen::Abort("DisplayList too small for buffer copies");
+				return;
+			}
+
+			// Copy the chain
+			// Packets are recorded back to back, so each tag in a copy points just past its own packet
+			for (size_t i = 1; i < copies; i++)
+			{
+				Word *copyp = base + words * i;
+				for (size_t j = 0; j < words; j++)
+					copyp[j] = base[j];
+
+				for (Word *tagp = copyp; tagp != copyp + (last - base);)
+				{
+					Word *nextp = tagp + ((Tag*)tagp)->Words() + 1;
+					new(tagp) Tag(nextp, ((Tag*)tagp)->Words());
+					tagp = nextp;
+				}
+			}
+		}
+
+		KEEP void DisplayList::Link(Layer layer, size_t ot)
+		{
+			// Link the current buffer's copy between the slot and what it pointed to
+			OTSync();
+
+			Buffer *bufferp = g_bufferp;
+			size_t offset = words * size_t(bufferp - buffers);
+			Tag *headp = (Tag*)(base + offset);
+			Tag *tailp = (Tag*)(last + offset);
+			Tag *otp = &bufferp->GetOT(layer, ot);
+
+			new(tailp) Tag(otp->Ptr(), tailp->Words());
+			new(otp) Tag(headp, 0);
+			bufferp->layer_used |= (1U << layer);
+		}
+
+		KEEP void DisplayList::Patch(const Word *word, Word value)
+		{
+			// Write the word in every copy
+			Word *wordp = (Word*)word;
+			for (size_t i = 0; i < copies; i++, wordp += words)
+				*wordp = value;
+		}
+
 		// Callbacks
 		KEEP FlipCallback SetFlipCallback(FlipCallback cb)
 		{
@@ -0,0 +1,107 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <CKSDK/GPU.h>
+
+namespace CKSDK
+{
+	namespace GPU
+	{
+		// Line batch constants
+		static constexpr size_t PACKET_WORDS = 16;
+
+		static constexpr size_t LINE_WORDS = sizeof(LinePrim<false>) / sizeof(Word);
+		static constexpr size_t GRAD_LINE_WORDS = sizeof(LinePrim<true>) / sizeof(Word);
+
+		// Poly-lines have a command word and terminator around their points
+		static constexpr size_t POLY_LINE_POINTS = PACKET_WORDS - 2;
+
+		static Word LineCmd(Word flags, bool semi)
+		{
+			return (GP0_Line | flags | (semi ? GP0_Line_Semi : 0)) << 24;
+		}
+
+		// Line batch functions
+		// Packets on the same ordering table slot run in reverse order, so they're emitted from the end
+		KEEP void AddLines(Layer layer, size_t ot, Color c, const ScreenCoord *points, size_t lines, bool semi)
+		{
+			constexpr size_t PACKET_LINES = PACKET_WORDS / LINE_WORDS;
+			Word cmd = LineCmd(0, semi) | (c.w & 0xFFFFFF);
+
+			while (lines != 0)
+			{
+				size_t n = ((lines - 1) % PACKET_LINES) + 1;
+				lines -= n;
+
+				Word *primp = AllocPacket(layer, ot, n * LINE_WORDS);
+				const ScreenCoord *pointp = &points[lines * 2];
+				for (size_t i = 0; i < n; i++, primp += LINE_WORDS, pointp += 2)
+				{
+					primp[0] = cmd;
+					primp[1] = pointp[0].w;
+					primp[2] = pointp[1].w;
+				}
+			}
+		}
+
+		KEEP void AddLines(Layer layer, size_t ot, const Color *colors, const ScreenCoord *points, size_t lines, bool semi)
+		{
+			constexpr size_t PACKET_LINES = PACKET_WORDS / GRAD_LINE_WORDS;
+			Word cmd = LineCmd(GP0_Line_Grad, semi);
+
+			while (lines != 0)
+			{
+				size_t n = ((lines - 1) % PACKET_LINES) + 1;
+				lines -= n;
+
+				Word *primp = AllocPacket(layer, ot, n * GRAD_LINE_WORDS);
+				const Color *colorp = &colors[lines * 2];
+				const ScreenCoord *pointp = &points[lines * 2];
+				for (size_t i = 0; i < n; i++, primp += GRAD_LINE_WORDS, colorp += 2, pointp += 2)
+				{
+					primp[0] = cmd | (colorp[0].w & 0xFFFFFF);
+					primp[1] = pointp[0].w;
+					primp[2] = colorp[1].w & 0xFFFFFF;
+					primp[3] = pointp[1].w;
+				}
+			}
+		}
+
+		KEEP void AddPolyLine(Layer layer, size_t ot, Color c, const ScreenCoord *points, size_t count, bool semi)
+		{
+			if (count < 2)
+				return;
+			Word cmd = LineCmd(GP0_Line_Poly, semi) | (c.w & 0xFFFFFF);
+
+			// Split the segments between poly-lines, which share their end points
+			size_t segments = count - 1;
+			while (segments != 0)
+			{
+				size_t n = ((segments - 1) % (POLY_LINE_POINTS - 1)) + 1;
+				segments -= n;
+
+				Word *primp = AllocPacket(layer, ot, n + 3);
+				*primp++ = cmd;
+
+				const ScreenCoord *pointp = &points[segments];
+				for (size_t i = 0; i <= n; i++)
+					*primp++ = pointp[i].w;
+				*primp = GP0_LineTerminator;
+			}
+		}
+	}
+}
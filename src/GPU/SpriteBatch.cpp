@@ -0,0 +1,162 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <CKSDK/GPU.h>
+
+namespace CKSDK
+{
+	namespace GPU
+	{
+		// Sprite batch constants
+		static constexpr size_t PACKET_WORDS = 16;
+		static constexpr size_t SPRITE_WORDS = sizeof(SpritePrim<>) / sizeof(Word);
+
+		// Sprites per packet, with and without a DrawMode command at the start
+		static constexpr size_t PACKET_SPRITES_MODE = (PACKET_WORDS - 1) / SPRITE_WORDS;
+		static constexpr size_t PACKET_SPRITES = PACKET_WORDS / SPRITE_WORDS;
+
+		// Sprites are copied as words, as Color's assignment keeps the command byte of the destination
+		static void CopySprite(Word *dst, const SpritePrim<> &prim)
+		{
+			const Word *src = (const Word*)&prim;
+			for (size_t i = 0; i < SPRITE_WORDS; i++)
+				dst[i] = src[i];
+		}
+
+		// Sprite batch functions
+		KEEP void SpriteBatch::Init(void *buffer, size_t capacity)
+		{
+			// Setup buffers
+			this->capacity = capacity;
+			sprites = (Sprite*)buffer;
+			order = (Sprite**)(sprites + capacity);
+			temp = order + capacity;
+
+			count = 0;
+			last_mode = 0;
+			ResetStats();
+		}
+
+		KEEP bool SpriteBatch::Add(uint8_t layer, DrawMode mode, const SpritePrim<> &prim)
+		{
+			// Check if there's space for the sprite
+			size_t i = count;
+			if (i >= capacity)
+				return false;
+			count = i + 1;
+
+			// Sort by batch layer, then texture page, semi transparency, and bit depth, then CLUT
+			Sprite *spritep = &sprites[i];
+			spritep->key = (Word(layer) << 24) | ((mode.mode & 0x1FF) << 15) | (prim.uv.s.x & 0x7FFF);
+			spritep->mode = mode;
+			CopySprite((Word*)&spritep->prim, prim);
+			order[i] = spritep;
+
+			// Count the draw mode changes we'd have without sorting
+			if (mode.mode != last_mode)
+			{
+				last_mode = mode.mode;
+				switches_unsorted++;
+			}
+			return true;
+		}
+
+		void SpriteBatch::Sort()
+		{
+			// LSD radix sort on the key, which is stable
+			// Passes where every key has the same byte are skipped, which is common for the batch layer
+			size_t counts[256];
+			for (unsigned shift = 0; shift < 32; shift += 8)
+			{
+				for (auto &i : counts)
+					i = 0;
+				for (size_t i = 0; i < count; i++)
+					counts[(order[i]->key >> shift) & 0xFF]++;
+				if (counts[(order[0]->key >> shift) & 0xFF] == count)
+					continue;
+
+				size_t offset = 0;
+				for (auto &i : counts)
+				{
+					size_t n = i;
+					i = offset;
+					offset += n;
+				}
+
+				for (size_t i = 0; i < count; i++)
+				{
+					Sprite *spritep = order[i];
+					temp[counts[(spritep->key >> shift) & 0xFF]++] = spritep;
+				}
+
+				Sprite **swap = order;
+				order = temp;
+				temp = swap;
+			}
+		}
+
+		KEEP void SpriteBatch::Flush(Layer layer, size_t ot)
+		{
+			if (count == 0)
+				return;
+			Sort();
+
+			// Packets on the same ordering table slot run in reverse order, so emit them from the end
+			// Each run of sprites with the same draw mode is a DrawMode command with the first few sprites, then packets of only sprites
+			size_t end = count;
+			while (end != 0)
+			{
+				// Find the start of the run
+				Word mode = order[end - 1]->mode.mode;
+				size_t start = end - 1;
+				while (start != 0 && order[start - 1]->mode.mode == mode)
+					start--;
+
+				size_t run = end - start;
+				size_t head = (run < PACKET_SPRITES_MODE) ? run : PACKET_SPRITES_MODE;
+
+				// Emit the sprite-only packets
+				for (size_t tail = run - head; tail != 0;)
+				{
+					size_t n = ((tail - 1) % PACKET_SPRITES) + 1;
+					tail -= n;
+
+					Word *primp = AllocPacket(layer, ot, n * SPRITE_WORDS);
+					Sprite **spritepp = &order[start + head + tail];
+					for (size_t i = 0; i < n; i++, primp += SPRITE_WORDS)
+						CopySprite(primp, spritepp[i]->prim);
+				}
+
+				// Emit the DrawMode command with the first sprites
+				Word *packetp = AllocPacket(layer, ot, 1 + head * SPRITE_WORDS);
+				packetp[0] = mode;
+
+				Word *primp = packetp + 1;
+				Sprite **spritepp = &order[start];
+				for (size_t i = 0; i < head; i++, primp += SPRITE_WORDS)
+					CopySprite(primp, spritepp[i]->prim);
+
+				switches++;
+				end = start;
+			}
+
+			// Empty the batch
+			count = 0;
+			last_mode = 0;
+		}
+	}
+}
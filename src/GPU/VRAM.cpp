@@ -0,0 +1,424 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <CKSDK/GPU.h>
+
+namespace CKSDK
+{
+	namespace GPU
+	{
+		// VRAM constants
+		static constexpr unsigned VRAM_WIDTH = 1024;
+		static constexpr unsigned VRAM_HEIGHT = 512;
+
+		static constexpr unsigned CELL_SIZE = VRAMAllocator::CELL_SIZE;
+		static constexpr unsigned CELLS_X = VRAM_WIDTH / CELL_SIZE;
+		static constexpr unsigned CELLS_Y = VRAM_HEIGHT / CELL_SIZE;
+
+		// A texture page is 64x256 units, which is a byte of cells wide
+		static constexpr unsigned TPAGE_CELLS_X = 64 / CELL_SIZE;
+		static constexpr unsigned TPAGE_CELLS_Y = 256 / CELL_SIZE;
+
+		// VRAM allocator
+		KEEP void VRAMAllocator::Init()
+		{
+			// Free everything
+			for (auto &i : cells)
+				for (auto &j : i)
+					j = 0;
+			clut_block_count = 0;
+
+			// Reserve framebuffers
+			Rect rects[BUFFER_MAX];
+			size_t count = GetFramebuffers(rects);
+			for (size_t i = 0; i < count; i++)
+				Reserve(rects[i]);
+		}
+
+		void VRAMAllocator::MarkCells(const Rect &rect, bool used)
+		{
+			// Get covered cells, clipped to VRAM
+			unsigned x0 = unsigned(rect.x) / CELL_SIZE;
+			unsigned y0 = unsigned(rect.y) / CELL_SIZE;
+			unsigned x1 = (unsigned(rect.x + rect.w) + CELL_SIZE - 1) / CELL_SIZE;
+			unsigned y1 = (unsigned(rect.y + rect.h) + CELL_SIZE - 1) / CELL_SIZE;
+			if (x1 > CELLS_X)
+				x1 = CELLS_X;
+			if (y1 > CELLS_Y)
+				y1 = CELLS_Y;
+
+			for (unsigned y = y0; y < y1; y++)
+			{
+				for (unsigned x = x0; x < x1; x++)
+				{
+					uint8_t &row = cells[y][x / TPAGE_CELLS_X];
+					uint8_t bit = 1 << (x % TPAGE_CELLS_X);
+					if (used)
+						row |= bit;
+					else
+						row &= ~bit;
+				}
+			}
+		}
+
+		bool VRAMAllocator::FindCells(unsigned w, unsigned h, unsigned align, Rect *rect)
+		{
+			// First fit within a texture page, testing a row of cells with a single mask
+			for (unsigned ty = 0; ty < (CELLS_Y / TPAGE_CELLS_Y); ty++)
+			{
+				for (unsigned tx = 0; tx < (CELLS_X / TPAGE_CELLS_X); tx++)
+				{
+					for (unsigned y = 0; y <= (TPAGE_CELLS_Y - h); y++)
+					{
+						const uint8_t (*rowp)[CELLS_X / TPAGE_CELLS_X] = &cells[ty * TPAGE_CELLS_Y + y];
+						for (unsigned x = 0; x <= (TPAGE_CELLS_X - w); x += align)
+						{
+							uint8_t mask = ((1 << w) - 1) << x;
+
+							unsigned i = 0;
+							for (; i < h; i++)
+							{
+								if (rowp[i][tx] & mask)
+									break;
+							}
+							if (i != h)
+								continue;
+
+							rect->x = (tx * TPAGE_CELLS_X + x) * CELL_SIZE;
+							rect->y = (ty * TPAGE_CELLS_Y + y) * CELL_SIZE;
+							rect->w = w * CELL_SIZE;
+							rect->h = h * CELL_SIZE;
+							return true;
+						}
+					}
+				}
+			}
+			return false;
+		}
+
+		KEEP void VRAMAllocator::Reserve(const Rect &rect)
+		{
+			MarkCells(rect, true);
+		}
+
+		KEEP bool VRAMAllocator::AllocTexture(uint16_t w, uint16_t h, BitDepth bpp, Rect *rect)
+		{
+			// Get size in units, then cells
+			unsigned units = (w + (1 << (2 - bpp)) - 1) >> (2 - bpp);
+			unsigned cw = (units + CELL_SIZE - 1) / CELL_SIZE;
+			unsigned ch = (h + CELL_SIZE - 1) / CELL_SIZE;
+			if (cw == 0 || ch == 0 || cw > TPAGE_CELLS_X || ch > TPAGE_CELLS_Y)
+				return false;
+
+			// Find and use space
+			if (!FindCells(cw, ch, 1, rect))
+				return false;
+			rect->w = units;
+			rect->h = h;
+			MarkCells(*rect, true);
+			return true;
+		}
+
+		KEEP bool VRAMAllocator::AllocTarget(uint16_t w, uint16_t h, Rect *rect)
+		{
+			// 15-bit texture coordinates reach 256 units from the texture page
+			unsigned cw = (w + CELL_SIZE - 1) / CELL_SIZE;
+			unsigned ch = (h + CELL_SIZE - 1) / CELL_SIZE;
+			if (cw == 0 || ch == 0 || cw > (256 / CELL_SIZE) || ch > TPAGE_CELLS_Y)
+				return false;
+
+			if (cw <= TPAGE_CELLS_X)
+			{
+				// Fits in a texture page, so it can go anywhere in one
+				if (!FindCells(cw, ch, 1, rect))
+					return false;
+			}
+			else
+			{
+				// Wider targets start at a texture page and span the ones after it
+				unsigned tpages = (cw + TPAGE_CELLS_X - 1) / TPAGE_CELLS_X;
+				bool found = false;
+				for (unsigned ty = 0; ty < (CELLS_Y / TPAGE_CELLS_Y) && !found; ty++)
+				{
+					for (unsigned tx = 0; tx <= ((CELLS_X / TPAGE_CELLS_X) - tpages) && !found; tx++)
+					{
+						for (unsigned y = 0; y <= (TPAGE_CELLS_Y - ch); y++)
+						{
+							const uint8_t (*rowp)[CELLS_X / TPAGE_CELLS_X] = &cells[ty * TPAGE_CELLS_Y + y];
+
+							unsigned i = 0;
+							for (; i < ch; i++)
+							{
+								unsigned j = 0;
+								for (; j < tpages; j++)
+								{
+									unsigned n = cw - j * TPAGE_CELLS_X;
+									uint8_t mask = (n >= TPAGE_CELLS_X) ? 0xFF : ((1 << n) - 1);
+									if (rowp[i][tx + j] & mask)
+										break;
+								}
+								if (j != tpages)
+									break;
+							}
+							if (i != ch)
+								continue;
+
+							rect->x = tx * 64;
+							rect->y = (ty * TPAGE_CELLS_Y + y) * CELL_SIZE;
+							found = true;
+							break;
+						}
+					}
+				}
+				if (!found)
+					return false;
+			}
+
+			rect->w = w;
+			rect->h = h;
+			MarkCells(*rect, true);
+			return true;
+		}
+
+		KEEP bool VRAMAllocator::AllocClut(uint16_t entries, Rect *rect)
+		{
+			if (entries != 16 && entries != 256)
+				return false;
+
+			// Use a free row of a block with the same width
+			for (unsigned i = 0; i < clut_block_count; i++)
+			{
+				ClutBlock &block = clut_blocks[i];
+				if (block.w != entries || block.used == 0xFF)
+					continue;
+
+				unsigned row = __builtin_ctz(~unsigned(block.used));
+				block.used |= 1 << row;
+				rect->x = block.x;
+				rect->y = block.y + row;
+				rect->w = entries;
+				rect->h = 1;
+				return true;
+			}
+
+			// Allocate a new block, a row of cells
+			if (clut_block_count >= CLUT_BLOCK_MAX)
+				return false;
+
+			Rect area;
+			if (entries == 16)
+			{
+				// 16 units wide, aligned to 16 units
+				if (!FindCells(16 / CELL_SIZE, 1, 16 / CELL_SIZE, &area))
+					return false;
+			}
+			else
+			{
+				// 256 units wide, which spans four texture pages
+				constexpr unsigned TPAGES = 256 / 64;
+				bool found = false;
+				for (unsigned y = 0; y < CELLS_Y && !found; y++)
+				{
+					for (unsigned tx = 0; tx <= ((CELLS_X / TPAGE_CELLS_X) - TPAGES); tx++)
+					{
+						unsigned i = 0;
+						for (; i < TPAGES; i++)
+						{
+							if (cells[y][tx + i] != 0)
+								break;
+						}
+						if (i != TPAGES)
+							continue;
+
+						area.x = tx * 64;
+						area.y = y * CELL_SIZE;
+						area.w = 256;
+						area.h = CELL_SIZE;
+						found = true;
+						break;
+					}
+				}
+				if (!found)
+					return false;
+			}
+			MarkCells(area, true);
+
+			ClutBlock &block = clut_blocks[clut_block_count++];
+			block.x = area.x;
+			block.y = area.y;
+			block.w = entries;
+			block.used = 1;
+
+			rect->x = block.x;
+			rect->y = block.y;
+			rect->w = entries;
+			rect->h = 1;
+			return true;
+		}
+
+		KEEP void VRAMAllocator::FreeClut(const Rect &rect)
+		{
+			// Find the block holding the CLUT
+			for (unsigned i = 0; i < clut_block_count; i++)
+			{
+				ClutBlock &block = clut_blocks[i];
+				if (block.x != rect.x || block.w != rect.w || rect.y < block.y || rect.y >= (block.y + int16_t(CELL_SIZE)))
+					continue;
+
+				// Free the row, and the block once it's empty
+				block.used &= ~(1 << (rect.y - block.y));
+				if (block.used == 0)
+				{
+					MarkCells(Rect{int16_t(block.x), int16_t(block.y), int16_t(block.w), int16_t(CELL_SIZE)}, false);
+					block = clut_blocks[--clut_block_count];
+				}
+				return;
+			}
+		}
+
+		KEEP unsigned VRAMAllocator::FreeCells() const
+		{
+			unsigned used = 0;
+			for (auto &i : cells)
+				for (auto &j : i)
+					used += __builtin_popcount(j);
+			return (CELLS_X * CELLS_Y) - used;
+		}
+
+		// Texture cache
+		KEEP void TextureCache::Init(VRAMAllocator *allocator)
+		{
+			this->allocator = allocator;
+			lru_head = lru_tail = nullptr;
+			frame = 0;
+			uploads = evictions = 0;
+		}
+
+		KEEP void TextureCache::Register(Texture &texture, const void *data, const void *clut_data, uint16_t w, uint16_t h, BitDepth bpp)
+		{
+			// A slot being reused for another texture has to give up the old one's VRAM first
+			if (texture.resident)
+				Evict(texture);
+
+			texture.data = data;
+			texture.clut_data = clut_data;
+			texture.w = w;
+			texture.h = h;
+			texture.bpp = bpp;
+			texture.resident = false;
+			texture.prev = texture.next = nullptr;
+		}
+
+		KEEP void TextureCache::Unregister(Texture &texture)
+		{
+			if (texture.resident)
+				Evict(texture);
+		}
+
+		void TextureCache::Evict(Texture &texture)
+		{
+			// Free VRAM
+			allocator->FreeTexture(texture.rect);
+			if (texture.clut_data != nullptr)
+				allocator->FreeClut(texture.clut_rect);
+			texture.resident = false;
+
+			// Unlink from LRU list
+			if (texture.prev != nullptr)
+				texture.prev->next = texture.next;
+			else
+				lru_head = texture.next;
+			if (texture.next != nullptr)
+				texture.next->prev = texture.prev;
+			else
+				lru_tail = texture.prev;
+			texture.prev = texture.next = nullptr;
+		}
+
+		bool TextureCache::EvictOldest()
+		{
+			// Textures used by frames that may still be drawing can't be evicted
+			Texture *texturep = lru_head;
+			if (texturep == nullptr || (frame - texturep->last_used) <= BUFFER_MAX)
+				return false;
+			Evict(*texturep);
+			evictions++;
+			return true;
+		}
+
+		KEEP bool TextureCache::Use(Texture &texture)
+		{
+			if (texture.resident)
+			{
+				// Move to the back of the LRU list
+				if (&texture != lru_tail)
+				{
+					if (texture.prev != nullptr)
+						texture.prev->next = texture.next;
+					else
+						lru_head = texture.next;
+					texture.next->prev = texture.prev;
+
+					texture.prev = lru_tail;
+					texture.next = nullptr;
+					lru_tail->next = &texture;
+					lru_tail = &texture;
+				}
+				texture.last_used = frame;
+				return true;
+			}
+
+			// Allocate VRAM, evicting old textures until it fits
+			while (!allocator->AllocTexture(texture.w, texture.h, texture.bpp, &texture.rect))
+			{
+				if (!EvictOldest())
+					return false;
+			}
+			if (texture.clut_data != nullptr)
+			{
+				uint16_t entries = (texture.bpp == BitDepth_4Bit) ? 16 : 256;
+				while (!allocator->AllocClut(entries, &texture.clut_rect))
+				{
+					if (!EvictOldest())
+					{
+						allocator->FreeTexture(texture.rect);
+						return false;
+					}
+				}
+
+				Queue_ImageLoad(texture.clut_data, texture.clut_rect.x, texture.clut_rect.y, texture.clut_rect.w, texture.clut_rect.h);
+				uploads++;
+			}
+
+			// Upload texture
+			Queue_ImageLoad(texture.data, texture.rect.x, texture.rect.y, texture.rect.w, texture.rect.h);
+			uploads++;
+
+			// Add to the back of the LRU list
+			texture.resident = true;
+			texture.last_used = frame;
+			texture.prev = lru_tail;
+			texture.next = nullptr;
+			if (lru_tail != nullptr)
+				lru_tail->next = &texture;
+			else
+				lru_head = &texture;
+			lru_tail = &texture;
+			return true;
+		}
+	}
+}
@@ -29,6 +29,18 @@ namespace CKSDK
 	void Init();
 }
 
+// Allocation attribution
+// In debug builds, memory allocated by new is attributed to the caller of new rather than new itself
+static inline void *Attribute(void *ptr, const void *caller)
+{
+	#ifdef CKSDK_MEM_DEBUG
+	CKSDK::Mem::SetCaller(ptr, caller);
+	#else
+	(void)caller;
+	#endif
+	return ptr;
+}
+
 extern "C"
 {
 	// C++ start
@@ -44,7 +56,7 @@ extern "C"
 	}
 
 	// GCC built-in new and delete
-	KEEP void *__builtin_new(size_t size) { return CKSDK::Mem::Alloc(size); }
+	KEEP void *__builtin_new(size_t size) { return Attribute(CKSDK::Mem::Alloc(size), __builtin_return_address(0)); }
 	KEEP void  __builtin_delete(void *ptr) { CKSDK::Mem::Free(ptr); }
 
 	// Pure virtual call
@@ -52,17 +64,22 @@ extern "C"
 }
 
 // C++ new and delete
-KEEP void *operator new(size_t size) noexcept { return CKSDK::Mem::Alloc(size); }
-KEEP void *operator new[](size_t size) noexcept { return CKSDK::Mem::Alloc(size); }
+KEEP void *operator new(size_t size) noexcept { return Attribute(CKSDK::Mem::Alloc(size), __builtin_return_address(0)); }
+KEEP void *operator new[](size_t size) noexcept { return Attribute(CKSDK::Mem::Alloc(size), __builtin_return_address(0)); }
 
-KEEP void *operator new(size_t size, std::align_val_t align) noexcept { (void)align; return CKSDK::Mem::Alloc(size); }
-KEEP void *operator new[](size_t size, std::align_val_t align) noexcept { (void)align; return CKSDK::Mem::Alloc(size); }
+KEEP void *operator new(size_t size, std::align_val_t align) noexcept { return Attribute(CKSDK::Mem::AllocAligned(size, size_t(align)), __builtin_return_address(0)); }
+KEEP void *operator new[](size_t size, std::align_val_t align) noexcept { return Attribute(CKSDK::Mem::AllocAligned(size, size_t(align)), __builtin_return_address(0)); }
 
 KEEP void operator delete(void *ptr) noexcept { CKSDK::Mem::Free(ptr); }
 KEEP void operator delete[](void *ptr) noexcept { CKSDK::Mem::Free(ptr); }
 KEEP void operator delete(void *ptr, size_t size) noexcept { (void)size; CKSDK::Mem::Free(ptr); }
 KEEP void operator delete[](void *ptr, size_t size) noexcept { (void)size; CKSDK::Mem::Free(ptr); }
 
+KEEP void operator delete(void *ptr, std::align_val_t align) noexcept { (void)align; CKSDK::Mem::Free(ptr); }
+KEEP void operator delete[](void *ptr, std::align_val_t align) noexcept { (void)align; CKSDK::Mem::Free(ptr); }
+KEEP void operator delete(void *ptr, size_t size, std::align_val_t align) noexcept { (void)size; (void)align; CKSDK::Mem::Free(ptr); }
+KEEP void operator delete[](void *ptr, size_t size, std::align_val_t align) noexcept { (void)size; (void)align; CKSDK::Mem::Free(ptr); }
+
 // EASTL allocator
 namespace eastl
 {
@@ -119,7 +136,7 @@ namespace eastl
 
 	KEEP inline void *allocator::allocate(size_t n, size_t alignment, size_t offset, int flags)
 	{
-		return CKSDK::Mem::Alloc(n);
+		return CKSDK::Mem::AllocAligned(n, alignment, offset);
 	}
 
 	KEEP inline void allocator::deallocate(void *p, size_t)
@@ -20,6 +20,9 @@
 .extern __bss_start
 .extern _end
 
+.extern __scratchpad_start
+.extern __scratchpad_end
+
 .extern __CTOR_LIST__
 
 # void _start(void);
@@ -40,6 +43,20 @@ _start:
 	bne   $t0, $t1, .Lclear_bss_loop
 	addiu $t0, 4
 
+	# Clear scratchpad section
+	la    $t0, __scratchpad_start
+	la    $t1, __scratchpad_end
+	beq   $t0, $t1, .Lno_clear_scratchpad_loop
+	nop
+
+.Lclear_scratchpad_loop:
+	sw    $zero, 0($t0)
+	addiu $t0, 4
+	bne   $t0, $t1, .Lclear_scratchpad_loop
+	nop
+
+.Lno_clear_scratchpad_loop:
+
 	# Run constructors
 	# This is done in reverse order as the linker places them in reverse order
 	la    $t0, __CTOR_LIST__
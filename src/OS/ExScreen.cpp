@@ -38,14 +38,17 @@ namespace CKSDK
 
 		static void Out(const char *str, unsigned x, unsigned y)
 		{
+			// Glyphs are sent in bursts
+			GPU::GP0_Writer writer;
 			while (1)
 			{
 				char c = *str++;
 				if (c == '\0')
 					return;
-				GPU::GP0_Cmd((GPU::GP0_Rect | GPU::GP0_Rect_8x8 | GPU::GP0_Rect_Tex | GPU::GP0_Rect_Raw) << 24);
-				GPU::GP0_Data((x << 0) | (y << 16));
-				GPU::GP0_Data((((c & 0xF) << 3) << 0) | ((((c - 0x20) >> 4) << 3) << 8) | ((62) << 16));
+				GPU::Word *glyph = writer.Alloc(3);
+				glyph[0] = (GPU::GP0_Rect | GPU::GP0_Rect_8x8 | GPU::GP0_Rect_Tex | GPU::GP0_Rect_Raw) << 24;
+				glyph[1] = (x << 0) | (y << 16);
+				glyph[2] = (((c & 0xF) << 3) << 0) | ((((c - 0x20) >> 4) << 3) << 8) | ((62) << 16);
 				x += 8;
 			}
 		}
@@ -176,9 +179,12 @@ namespace CKSDK
 			GPU::SetQueueCallback(nullptr);
 
 			// Reset GPU
+			// The buffer count is kept from the game, so every buffer is given the same framebuffer
+			// The queue is dropped first, as SetScreen waits for it and IRQs are still disabled
 			GPU::Init();
-			GPU::SetScreen(WIDTH, HEIGHT, 0, 0, 0, 0, 0, 0);
 			GPU::QueueReset();
+			GPU::ScreenCoord framebuffers[GPU::BUFFER_MAX]; // All at 0, 0
+			GPU::SetScreen(WIDTH, HEIGHT, 0, 0, framebuffers);
 
 			// Reset SPI
 			SPI::Init();
@@ -22,6 +22,12 @@
 
 #include <CKSDK/TTY.h>
 
+// C externs
+extern "C"
+{
+	extern char __scratchpad_end[];
+}
+
 namespace CKSDK
 {
 	namespace Mem
@@ -35,19 +41,64 @@ namespace CKSDK
 		template<typename T>
 		static constexpr T AlignEnd(T x) { return T((uintptr_t)x & ~(ALIGNMENT - 1)); }
 		
+		// Allocation caller, recorded per block in debug builds
+		#ifdef CKSDK_MEM_DEBUG
+		#define MEM_CALLER __builtin_return_address(0)
+		#else
+		#define MEM_CALLER nullptr
+		#endif
+
+		// Realloc statistics
+		static size_t realloc_in_place, realloc_moved, realloc_copied;
+
+		KEEP void ProfileRealloc(size_t *in_place, size_t *moved, size_t *copied)
+		{
+			OS::DisableIRQ();
+
+			if (in_place != nullptr)
+				*in_place = realloc_in_place;
+			if (moved != nullptr)
+				*moved = realloc_moved;
+			if (copied != nullptr)
+				*copied = realloc_copied;
+
+			OS::EnableIRQ();
+		}
+
+		#ifdef CKSDK_MEM_FIRSTFIT
 		// Mem heap
 		struct Block
 		{
 			Block *prev, *next;
 			size_t size;
+			#ifdef CKSDK_MEM_DEBUG
+			const void *caller;
+			#endif
+		};
+
+		struct Control
+		{
+			// Heap head block, which spans the whole heap
+			Block *mem;
+
+			// Statistics
+			size_t used, peak;
 		};
-		static Block *mem;
 
 		// Mem block search
-		static Block *Search(size_t size, Block **const out_prev)
+		static inline char *AlignHead(char *hpos, size_t align, size_t offset)
+		{
+			// Get the first block position at or after hpos where the data plus offset is aligned
+			uintptr_t data = (uintptr_t)hpos + Align(sizeof(Block)) + offset;
+			data = (data + (align - 1)) & ~(align - 1);
+			return (char*)(data - offset - Align(sizeof(Block)));
+		}
+
+		static Block *Search(Control *ctl, size_t size, size_t align, size_t offset, Block **const out_prev)
 		{
 			// Get block pointer
 			Block *head, *prev, *next;
+			Block *mem = ctl->mem;
 			char *hpos = (char*)mem + Align(sizeof(Block));
 
 			prev = mem;
@@ -55,14 +106,14 @@ namespace CKSDK
 
 			while (1)
 			{
+				char *apos = AlignHead(hpos, align, offset);
 				if (next != nullptr)
 				{
 					// Check against the next block
-					size_t cleft = (char*)next - hpos;
-					if (cleft >= size)
+					if ((apos + size) <= (char*)next)
 					{
 						// Set pointer
-						head = (Block*)hpos;
+						head = (Block*)apos;
 						break;
 					}
 
@@ -74,12 +125,11 @@ namespace CKSDK
 				else
 				{
 					// Check against end of heap
-					size_t cleft = ((char*)mem + mem->size) - hpos;
-					if (cleft < size)
+					if ((apos + size) > ((char*)mem + mem->size))
 						return nullptr;
 
 					// Set pointer
-					head = (Block*)hpos;
+					head = (Block*)apos;
 					break;
 				}
 			}
@@ -89,18 +139,24 @@ namespace CKSDK
 			return head;
 		}
 
-		// Mem functions
-		KEEP void Init(void *ptr, size_t size)
+		// Heap functions
+		static void HeapInit(Control *ctl, void *ptr, size_t size)
 		{
 			// Initialize block
-			mem = (Block*)Align(ptr);
+			ctl->used = ctl->peak = 0;
+			Block *mem = ctl->mem = (Block*)Align(ptr);
 			mem->prev = nullptr;
 			mem->next = nullptr;
 			mem->size = AlignEnd(((uintptr_t)ptr + size) - (uintptr_t)mem);
 		}
-		
-		KEEP void *Alloc(size_t size)
+
+		static void *HeapAllocAligned(Control *ctl, size_t size, size_t align, size_t offset, const void *caller)
 		{
+			// Get alignment
+			if (align < ALIGNMENT)
+				align = ALIGNMENT;
+			offset = AlignEnd(offset);
+
 			OS::DisableIRQ();
 
 			// Align size
@@ -108,9 +164,12 @@ namespace CKSDK
 
 			// Search for free block
 			Block *head, *prev;
-			head = Search(size, &prev);
+			head = Search(ctl, size, align, offset, &prev);
 			if (head == nullptr)
+			{
+				OS::EnableIRQ();
 				return nullptr;
+			}
 
 			// Link block
 			head->size = size;
@@ -119,58 +178,104 @@ namespace CKSDK
 				head->next->prev = head;
 			prev->next = head;
 
+			#ifdef CKSDK_MEM_DEBUG
+			head->caller = caller;
+			#else
+			(void)caller;
+			#endif
+
+			if ((ctl->used += size) > ctl->peak)
+				ctl->peak = ctl->used;
+
 			// Return pointer
 			OS::EnableIRQ();
 			return (void*)((char*)head + Align(sizeof(Block)));
 		}
 
-		KEEP void *Realloc(void *ptr, size_t size)
+		static void *HeapAlloc(Control *ctl, size_t size, const void *caller)
+		{
+			return HeapAllocAligned(ctl, size, ALIGNMENT, 0, caller);
+		}
+
+		static void *HeapRealloc(Control *ctl, void *ptr, size_t size, const void *caller)
 		{
 			OS::DisableIRQ();
 
 			// Get block
-			if (ptr == nullptr)
-				return Alloc(size);
+			Block *mem = ctl->mem;
 			Block *head = (Block*)((char*)ptr - Align(sizeof(Block)));
-			
-			// Unlink block
-			if ((head->prev->next = head->next) != nullptr)
-				head->next->prev = head->prev;
 
 			// Align size
 			size = Align(size) + Align(sizeof(Block));
 
+			// Resize in place if the block fits before the next block
+			char *limit = (head->next != nullptr) ? (char*)head->next : ((char*)mem + mem->size);
+			if (((char*)head + size) <= limit)
+			{
+				if ((ctl->used += size - head->size) > ctl->peak)
+					ctl->peak = ctl->used;
+				head->size = size;
+				#ifdef CKSDK_MEM_DEBUG
+				head->caller = caller;
+				#endif
+				realloc_in_place++;
+
+				OS::EnableIRQ();
+				return ptr;
+			}
+
+			// Unlink block
+			if ((head->prev->next = head->next) != nullptr)
+				head->next->prev = head->prev;
+
 			// Search for free block
 			Block *newhead, *newprev;
-			newhead = Search(size, &newprev);
+			newhead = Search(ctl, size, ALIGNMENT, 0, &newprev);
 			if (newhead == nullptr)
+			{
+				// Relink block
+				head->prev->next = head;
+				if (head->next != nullptr)
+					head->next->prev = head;
+				OS::EnableIRQ();
 				return nullptr;
+			}
 
-			// Copy data over
-			if (head->size > size)
-				__builtin_memcpy((char*)newhead + Align(sizeof(Block)), (char*)ptr, size - Align(sizeof(Block)));
-			else
-				__builtin_memcpy((char*)newhead + Align(sizeof(Block)), (char*)ptr, head->size - Align(sizeof(Block)));
+			if ((ctl->used += size - head->size) > ctl->peak)
+				ctl->peak = ctl->used;
+
+			// Move data over
+			// The new block may overlap the old one, as it has already been unlinked
+			size_t copy = ((head->size > size) ? size : head->size) - Align(sizeof(Block));
+			__builtin_memmove((char*)newhead + Align(sizeof(Block)), (char*)ptr, copy);
+
+			realloc_moved++;
+			realloc_copied += copy;
 
 			// Link block
-			head->size = size;
-			head->prev = newprev;
-			if ((head->next = newprev->next) != nullptr)
-				head->next->prev = head;
-			newprev->next = head;
+			newhead->size = size;
+			newhead->prev = newprev;
+			if ((newhead->next = newprev->next) != nullptr)
+				newhead->next->prev = newhead;
+			newprev->next = newhead;
+
+			#ifdef CKSDK_MEM_DEBUG
+			newhead->caller = caller;
+			#else
+			(void)caller;
+			#endif
 
 			OS::EnableIRQ();
-			return (void*)((char*)head + Align(sizeof(Block)));
+			return (void*)((char*)newhead + Align(sizeof(Block)));
 		}
 
-		KEEP void Free(void *ptr)
+		static void HeapFree(Control *ctl, void *ptr)
 		{
 			OS::DisableIRQ();
 
 			// Get block
-			if (ptr == nullptr)
-				return;
 			Block *head = (Block*)((char*)ptr - Align(sizeof(Block)));
+			ctl->used -= head->size;
 
 			// Unlink block
 			if ((head->prev->next = head->next) != nullptr)
@@ -179,17 +284,13 @@ namespace CKSDK
 			OS::EnableIRQ();
 		}
 
-		KEEP void Profile(size_t *used, size_t *total, size_t *blocks)
+		static void HeapProfile(Control *ctl, size_t *used, size_t *total, size_t *blocks)
 		{
 			OS::DisableIRQ();
 
+			Block *mem = ctl->mem;
 			if (used != nullptr)
-			{
-				size_t u = 0;
-				for (Block *head = mem->next; head != nullptr; head = head->next)
-					u += head->size;
-				*used = u;
-			}
+				*used = ctl->used;
 			if (total != nullptr)
 				*total = mem->size - Align(sizeof(Block));
 			if (blocks != nullptr)
@@ -202,5 +303,1157 @@ namespace CKSDK
 
 			OS::EnableIRQ();
 		}
+
+		static void HeapStats(Control *ctl, Stats *stats)
+		{
+			OS::DisableIRQ();
+
+			Block *mem = ctl->mem;
+			stats->used = ctl->used;
+			stats->total = mem->size - Align(sizeof(Block));
+			stats->peak = ctl->peak;
+
+			// Walk the gaps between blocks
+			size_t blocks = 0, largest_free = 0, free_blocks = 0;
+			char *hpos = (char*)mem + Align(sizeof(Block));
+			for (Block *head = mem->next;; head = head->next)
+			{
+				size_t gap = ((head != nullptr) ? (char*)head : ((char*)mem + mem->size)) - hpos;
+				if (gap != 0)
+				{
+					free_blocks++;
+					if (gap > largest_free)
+						largest_free = gap;
+				}
+				if (head == nullptr)
+					break;
+
+				blocks++;
+				hpos = (char*)head + head->size;
+			}
+			stats->blocks = blocks;
+			stats->largest_free = largest_free;
+			stats->free_blocks = free_blocks;
+
+			OS::EnableIRQ();
+		}
+
+		static void HeapResetPeak(Control *ctl)
+		{
+			ctl->peak = ctl->used;
+		}
+
+		static void HeapSetCaller(void *ptr, const void *caller)
+		{
+			#ifdef CKSDK_MEM_DEBUG
+			((Block*)((char*)ptr - Align(sizeof(Block))))->caller = caller;
+			#else
+			(void)ptr;
+			(void)caller;
+			#endif
+		}
+
+		template<typename F>
+		static void HeapWalk(Control *ctl, char *start, F &&func)
+		{
+			// Visit the gaps between blocks as free blocks
+			(void)start;
+			Block *mem = ctl->mem;
+			char *hpos = (char*)mem + Align(sizeof(Block));
+			for (Block *head = mem->next;; head = head->next)
+			{
+				size_t gap = ((head != nullptr) ? (char*)head : ((char*)mem + mem->size)) - hpos;
+				if (gap != 0)
+					func(gap, true, nullptr);
+				if (head == nullptr)
+					break;
+
+				#ifdef CKSDK_MEM_DEBUG
+				func(head->size, false, head->caller);
+				#else
+				func(head->size, false, nullptr);
+				#endif
+				hpos = (char*)head + head->size;
+			}
+		}
+		#else
+		// TLSF (two-level segregated fit) heap
+		// Free blocks are binned by size into first level classes (powers of 2), each split linearly into
+		// second level classes. Bitmaps of non-empty bins let us find a suitable block without searching.
+		static constexpr unsigned ALIGNMENT_LOG2 = 3;
+		static_assert(ALIGNMENT == (1 << ALIGNMENT_LOG2));
+
+		static constexpr unsigned SL_INDEX_COUNT_LOG2 = 4;
+		static constexpr unsigned SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2;
+
+		static constexpr unsigned FL_INDEX_MAX = 24; // Blocks up to 16MiB
+		static constexpr unsigned FL_INDEX_SHIFT = SL_INDEX_COUNT_LOG2 + ALIGNMENT_LOG2;
+		static constexpr unsigned FL_INDEX_COUNT = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+
+		static constexpr size_t SMALL_BLOCK_SIZE = 1 << FL_INDEX_SHIFT;
+		static constexpr size_t MAX_BLOCK_SIZE = 1 << FL_INDEX_MAX;
+
+		// Mem heap
+		struct Block
+		{
+			// Previous physical block
+			Block *prev_phys;
+			// Size of the block including the header, bit 0 is set if the block is free
+			size_t size;
+
+			#ifdef CKSDK_MEM_DEBUG
+			// Caller that allocated the block, padded to keep the header aligned
+			const void *caller;
+			uint32_t pad;
+			#endif
+
+			// Free list links (only valid if the block is free)
+			Block *next_free, *prev_free;
+		};
+
+		static constexpr size_t BLOCK_HEADER = offsetof(Block, next_free);
+		static constexpr size_t BLOCK_MIN = sizeof(Block);
+		static constexpr size_t BLOCK_FREE = 1;
+		static_assert((BLOCK_HEADER % ALIGNMENT) == 0);
+		static_assert((BLOCK_MIN % ALIGNMENT) == 0);
+
+		struct Control
+		{
+			// Bitmaps of non-empty free lists
+			uint32_t fl_bitmap;
+			uint32_t sl_bitmap[FL_INDEX_COUNT];
+
+			// Free list heads
+			Block *blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+			// Statistics
+			size_t total, used, count, peak, free_count;
+		};
+
+		// Bit scan helpers
+		static inline unsigned Ffs(uint32_t x) { return __builtin_ctz(x); }
+		static inline unsigned Fls(uint32_t x) { return 31 - __builtin_clz(x); }
+
+		// Block helpers
+		static inline size_t BlockSize(const Block *block) { return block->size & ~BLOCK_FREE; }
+		static inline bool BlockIsFree(const Block *block) { return (block->size & BLOCK_FREE) != 0; }
+
+		static inline Block *BlockNext(Block *block) { return (Block*)((char*)block + BlockSize(block)); }
+
+		static inline void *BlockToPtr(Block *block) { return (void*)((char*)block + BLOCK_HEADER); }
+		static inline Block *PtrToBlock(void *ptr) { return (Block*)((char*)ptr - BLOCK_HEADER); }
+
+		static inline size_t AdjustSize(size_t size)
+		{
+			// Get the block size needed to hold the given size
+			if (size >= MAX_BLOCK_SIZE)
+				return 0;
+			size = Align(size) + BLOCK_HEADER;
+			return (size < BLOCK_MIN) ? BLOCK_MIN : size;
+		}
+
+		// Free list mapping
+		static inline void MappingInsert(size_t size, unsigned *fli, unsigned *sli)
+		{
+			if (size < SMALL_BLOCK_SIZE)
+			{
+				// Small blocks are stored linearly in the first list
+				*fli = 0;
+				*sli = size >> ALIGNMENT_LOG2;
+			}
+			else
+			{
+				unsigned fl = Fls(size);
+				*sli = (size >> (fl - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+				*fli = fl - (FL_INDEX_SHIFT - 1);
+			}
+		}
+
+		static inline void MappingSearch(size_t size, unsigned *fli, unsigned *sli)
+		{
+			// Round up to the next list so any block found is large enough
+			if (size >= SMALL_BLOCK_SIZE)
+				size += (1 << (Fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+			MappingInsert(size, fli, sli);
+		}
+
+		// Free list functions
+		static void InsertFree(Control *ctl, Block *block)
+		{
+			unsigned fl, sl;
+			MappingInsert(BlockSize(block), &fl, &sl);
+
+			// Link block to the head of the list
+			Block *head = ctl->blocks[fl][sl];
+			block->prev_free = nullptr;
+			if ((block->next_free = head) != nullptr)
+				head->prev_free = block;
+			ctl->blocks[fl][sl] = block;
+
+			// Mark list as non-empty
+			ctl->fl_bitmap |= (1U << fl);
+			ctl->sl_bitmap[fl] |= (1U << sl);
+
+			block->size |= BLOCK_FREE;
+			ctl->free_count++;
+		}
+
+		static void RemoveFree(Control *ctl, Block *block)
+		{
+			unsigned fl, sl;
+			MappingInsert(BlockSize(block), &fl, &sl);
+
+			// Unlink block
+			Block *prev = block->prev_free;
+			Block *next = block->next_free;
+			if (next != nullptr)
+				next->prev_free = prev;
+			if (prev != nullptr)
+			{
+				prev->next_free = next;
+			}
+			else
+			{
+				// Block was the head of the list, mark list as empty if it was the last block
+				ctl->blocks[fl][sl] = next;
+				if (next == nullptr)
+				{
+					if ((ctl->sl_bitmap[fl] &= ~(1U << sl)) == 0)
+						ctl->fl_bitmap &= ~(1U << fl);
+				}
+			}
+
+			block->size &= ~BLOCK_FREE;
+			ctl->free_count--;
+		}
+
+		static Block *SearchFree(Control *ctl, size_t size)
+		{
+			unsigned fl, sl;
+			MappingSearch(size, &fl, &sl);
+			if (fl >= FL_INDEX_COUNT)
+				return nullptr;
+
+			// Search for a non-empty list in this first level class
+			uint32_t sl_map = ctl->sl_bitmap[fl] & (~0U << sl);
+			if (sl_map == 0)
+			{
+				// Search for a non-empty first level class
+				uint32_t fl_map = ctl->fl_bitmap & (~0U << (fl + 1));
+				if (fl_map == 0)
+					return nullptr;
+
+				fl = Ffs(fl_map);
+				sl_map = ctl->sl_bitmap[fl];
+			}
+			sl = Ffs(sl_map);
+
+			return ctl->blocks[fl][sl];
+		}
+
+		// Block functions
+		static void MergeNext(Control *ctl, Block *block)
+		{
+			// Absorb the next block if it's free
+			Block *next = BlockNext(block);
+			if (!BlockIsFree(next))
+				return;
+
+			RemoveFree(ctl, next);
+			block->size += BlockSize(next);
+			BlockNext(block)->prev_phys = block;
+		}
+
+		static void Split(Control *ctl, Block *block, size_t size)
+		{
+			// Check if the remainder is large enough to be a block of its own
+			size_t bsize = BlockSize(block);
+			if ((bsize - size) < BLOCK_MIN)
+				return;
+
+			// Split remainder off and release it
+			Block *rem = (Block*)((char*)block + size);
+			rem->prev_phys = block;
+			rem->size = bsize - size;
+			BlockNext(rem)->prev_phys = rem;
+
+			block->size = size | (block->size & BLOCK_FREE);
+
+			MergeNext(ctl, rem);
+			InsertFree(ctl, rem);
+		}
+
+		// Heap functions
+		static void HeapInit(Control *ctl, void *ptr, size_t size)
+		{
+			// Reset control
+			__builtin_memset(ctl, 0, sizeof(*ctl));
+
+			// Get heap bounds, leaving space for the sentinel header at the end
+			char *start = Align((char*)ptr);
+			char *end = AlignEnd((char*)ptr + size) - BLOCK_HEADER;
+
+			size_t bsize = end - start;
+			if (bsize >= MAX_BLOCK_SIZE)
+				bsize = AlignEnd(MAX_BLOCK_SIZE - 1);
+			end = start + bsize;
+
+			// Initialize sentinel block, which is never free and stops merges at the end of the heap
+			Block *block = (Block*)start;
+			Block *sentinel = (Block*)end;
+
+			block->prev_phys = nullptr;
+			block->size = bsize;
+
+			sentinel->prev_phys = block;
+			sentinel->size = 0;
+
+			// Release heap block
+			InsertFree(ctl, block);
+			ctl->total = bsize;
+		}
+
+		static inline void UseBlock(Control *ctl, Block *block, const void *caller)
+		{
+			// Account for the block and record who allocated it
+			if ((ctl->used += BlockSize(block)) > ctl->peak)
+				ctl->peak = ctl->used;
+			ctl->count++;
+
+			#ifdef CKSDK_MEM_DEBUG
+			block->caller = caller;
+			#else
+			(void)caller;
+			#endif
+		}
+
+		static void *HeapAlloc(Control *ctl, size_t size, const void *caller)
+		{
+			// Get block size
+			if ((size = AdjustSize(size)) == 0)
+				return nullptr;
+
+			OS::DisableIRQ();
+
+			// Search for free block
+			Block *block = SearchFree(ctl, size);
+			if (block == nullptr)
+			{
+				OS::EnableIRQ();
+				return nullptr;
+			}
+
+			// Use block and release the remainder
+			RemoveFree(ctl, block);
+			Split(ctl, block, size);
+			UseBlock(ctl, block, caller);
+
+			// Return pointer
+			OS::EnableIRQ();
+			return BlockToPtr(block);
+		}
+
+		static void *HeapAllocAligned(Control *ctl, size_t size, size_t align, size_t offset, const void *caller)
+		{
+			// Get alignment
+			offset = AlignEnd(offset);
+			if (align <= ALIGNMENT)
+				return HeapAlloc(ctl, size, caller);
+
+			// Get block size
+			if ((size = AdjustSize(size)) == 0)
+				return nullptr;
+
+			OS::DisableIRQ();
+
+			// Search for a free block with room for the largest gap alignment could leave
+			Block *block = SearchFree(ctl, size + align + BLOCK_MIN);
+			if (block == nullptr)
+			{
+				OS::EnableIRQ();
+				return nullptr;
+			}
+			RemoveFree(ctl, block);
+
+			// Find aligned position, the gap before it must be able to hold a free block
+			uintptr_t data = (uintptr_t)BlockToPtr(block);
+			size_t gap = (((data + offset + (align - 1)) & ~(align - 1)) - offset) - data;
+			while (gap != 0 && gap < BLOCK_MIN)
+				gap += align;
+
+			if (gap != 0)
+			{
+				// Split gap off and release it
+				// The previous block can't be free, so this doesn't need to merge
+				Block *ablock = (Block*)((char*)block + gap);
+				ablock->prev_phys = block;
+				ablock->size = BlockSize(block) - gap;
+				BlockNext(ablock)->prev_phys = ablock;
+
+				block->size = gap;
+				InsertFree(ctl, block);
+				block = ablock;
+			}
+
+			// Use block and release the remainder
+			Split(ctl, block, size);
+			UseBlock(ctl, block, caller);
+
+			// Return pointer
+			OS::EnableIRQ();
+			return BlockToPtr(block);
+		}
+
+		static void HeapFree(Control *ctl, void *ptr)
+		{
+			// Get block
+			Block *block = PtrToBlock(ptr);
+
+			OS::DisableIRQ();
+
+			ctl->used -= BlockSize(block);
+			ctl->count--;
+
+			// Merge with free neighbours
+			Block *prev = block->prev_phys;
+			if (prev != nullptr && BlockIsFree(prev))
+			{
+				RemoveFree(ctl, prev);
+				prev->size += BlockSize(block);
+				BlockNext(prev)->prev_phys = prev;
+				block = prev;
+			}
+			MergeNext(ctl, block);
+
+			// Release block
+			InsertFree(ctl, block);
+
+			OS::EnableIRQ();
+		}
+
+		static void *HeapRealloc(Control *ctl, void *ptr, size_t size, const void *caller)
+		{
+			// Get block
+			Block *block = PtrToBlock(ptr);
+
+			// Get block size
+			size_t bsize = AdjustSize(size);
+			if (bsize == 0)
+				return nullptr;
+
+			OS::DisableIRQ();
+
+			// Grow into the next block if it's free and large enough, or shrink in place
+			size_t cur = BlockSize(block);
+			Block *next = BlockNext(block);
+			if (bsize <= cur || (BlockIsFree(next) && (cur + BlockSize(next)) >= bsize))
+			{
+				ctl->used -= cur;
+				ctl->count--;
+				if (bsize > cur)
+					MergeNext(ctl, block);
+				Split(ctl, block, bsize);
+				UseBlock(ctl, block, caller);
+				realloc_in_place++;
+
+				OS::EnableIRQ();
+				return ptr;
+			}
+
+			// Allocate new block
+			void *newptr = HeapAlloc(ctl, size, caller);
+			if (newptr == nullptr)
+			{
+				OS::EnableIRQ();
+				return nullptr;
+			}
+
+			// Copy data over and free old block
+			size_t copy = cur - BLOCK_HEADER;
+			if (copy > size)
+				copy = size;
+			__builtin_memcpy(newptr, ptr, copy);
+
+			HeapFree(ctl, ptr);
+
+			realloc_moved++;
+			realloc_copied += copy;
+
+			OS::EnableIRQ();
+			return newptr;
+		}
+
+		static void HeapProfile(Control *ctl, size_t *used, size_t *total, size_t *blocks)
+		{
+			OS::DisableIRQ();
+
+			if (used != nullptr)
+				*used = ctl->used;
+			if (total != nullptr)
+				*total = ctl->total;
+			if (blocks != nullptr)
+				*blocks = ctl->count;
+
+			OS::EnableIRQ();
+		}
+
+		static void HeapStats(Control *ctl, Stats *stats)
+		{
+			OS::DisableIRQ();
+
+			stats->used = ctl->used;
+			stats->total = ctl->total;
+			stats->blocks = ctl->count;
+			stats->peak = ctl->peak;
+			stats->free_blocks = ctl->free_count;
+
+			// The largest free block is in the highest non-empty list
+			size_t largest_free = 0;
+			if (ctl->fl_bitmap != 0)
+			{
+				unsigned fl = Fls(ctl->fl_bitmap);
+				unsigned sl = Fls(ctl->sl_bitmap[fl]);
+				for (Block *block = ctl->blocks[fl][sl]; block != nullptr; block = block->next_free)
+				{
+					if (BlockSize(block) > largest_free)
+						largest_free = BlockSize(block);
+				}
+			}
+			stats->largest_free = largest_free;
+
+			OS::EnableIRQ();
+		}
+
+		static void HeapResetPeak(Control *ctl)
+		{
+			ctl->peak = ctl->used;
+		}
+
+		static void HeapSetCaller(void *ptr, const void *caller)
+		{
+			#ifdef CKSDK_MEM_DEBUG
+			PtrToBlock(ptr)->caller = caller;
+			#else
+			(void)ptr;
+			(void)caller;
+			#endif
+		}
+
+		template<typename F>
+		static void HeapWalk(Control *ctl, char *start, F &&func)
+		{
+			// Visit every physical block up to the sentinel
+			(void)ctl;
+			for (Block *block = (Block*)start; BlockSize(block) != 0; block = BlockNext(block))
+			{
+				#ifdef CKSDK_MEM_DEBUG
+				func(BlockSize(block), BlockIsFree(block), BlockIsFree(block) ? nullptr : block->caller);
+				#else
+				func(BlockSize(block), BlockIsFree(block), nullptr);
+				#endif
+			}
+		}
+		#endif
+
+		// Mem heaps
+		struct Heap
+		{
+			// Allocator control
+			Control ctl;
+
+			// Heap name and bounds
+			const char *name;
+			char *start, *end;
+		};
+
+		static constexpr unsigned HEAP_MAX = 4;
+
+		static Heap *heaps[HEAP_MAX];
+		static unsigned heap_count;
+
+		static Heap *routes[Tag_Count];
+
+		static Heap *FindOwner(void *ptr)
+		{
+			// Find the heap the pointer was allocated from
+			for (unsigned i = 0; i < heap_count; i++)
+			{
+				Heap *heap = heaps[i];
+				if ((char*)ptr >= heap->start && (char*)ptr < heap->end)
+					return heap;
+			}
+			return nullptr;
+		}
+
+		// Heap management functions
+		KEEP Heap *CreateHeap(void *ptr, size_t size, const char *name)
+		{
+			// Place the heap at the start of the region and use the rest for allocations
+			Heap *heap = Align((Heap*)ptr);
+			char *start = (char*)heap + Align(sizeof(Heap));
+			char *end = (char*)ptr + size;
+			if (heap_count >= HEAP_MAX || end <= (start + Align(sizeof(Block)) * 4))
+				return nullptr;
+
+			HeapInit(&heap->ctl, start, end - start);
+			heap->name = name;
+			heap->start = start;
+			heap->end = end;
+
+			// Register heap
+			OS::DisableIRQ();
+			heaps[heap_count++] = heap;
+			OS::EnableIRQ();
+
+			return heap;
+		}
+
+		KEEP Heap *FindHeap(const char *name)
+		{
+			for (unsigned i = 0; i < heap_count; i++)
+			{
+				if (__builtin_strcmp(heaps[i]->name, name) == 0)
+					return heaps[i];
+			}
+			return nullptr;
+		}
+
+		KEEP const char *HeapName(const Heap *heap)
+		{
+			return heap->name;
+		}
+
+		KEEP Heap *SetHeap(Tag tag, Heap *heap)
+		{
+			// Route tag to the general heap if no heap is given
+			if (heap == nullptr)
+				heap = heaps[0];
+
+			Heap *prev = routes[tag];
+			routes[tag] = heap;
+			return prev;
+		}
+
+		KEEP Heap *GetHeap(Tag tag)
+		{
+			return routes[tag];
+		}
+
+		// Mem functions
+		KEEP void Init(void *ptr, size_t size)
+		{
+			// Create the main heap and route all tags to it
+			heap_count = 0;
+			Heap *heap = CreateHeap(ptr, size, "Main");
+			for (auto &i : routes)
+				i = heap;
+		}
+
+		KEEP void *Alloc(size_t size)
+		{
+			return HeapAlloc(&routes[Tag_General]->ctl, size, MEM_CALLER);
+		}
+
+		KEEP void *Alloc(size_t size, Tag tag)
+		{
+			return HeapAlloc(&routes[tag]->ctl, size, MEM_CALLER);
+		}
+
+		KEEP void *Alloc(Heap *heap, size_t size)
+		{
+			return HeapAlloc(&heap->ctl, size, MEM_CALLER);
+		}
+
+		KEEP void *AllocAligned(size_t size, size_t align, size_t offset)
+		{
+			return HeapAllocAligned(&routes[Tag_General]->ctl, size, align, offset, MEM_CALLER);
+		}
+
+		KEEP void *AllocAligned(size_t size, size_t align, size_t offset, Tag tag)
+		{
+			return HeapAllocAligned(&routes[tag]->ctl, size, align, offset, MEM_CALLER);
+		}
+
+		KEEP void *AllocAligned(Heap *heap, size_t size, size_t align, size_t offset)
+		{
+			return HeapAllocAligned(&heap->ctl, size, align, offset, MEM_CALLER);
+		}
+
+		KEEP void *Realloc(void *ptr, size_t size)
+		{
+			// Get heap
+			if (ptr == nullptr)
+				return HeapAlloc(&routes[Tag_General]->ctl, size, MEM_CALLER);
+			Heap *heap = FindOwner(ptr);
+			if (heap == nullptr)
+				return nullptr;
+
+			// Reallocate within the same heap
+			return HeapRealloc(&heap->ctl, ptr, size, MEM_CALLER);
+		}
+
+		KEEP void Free(void *ptr)
+		{
+			// Get heap
+			if (ptr == nullptr)
+				return;
+			Heap *heap = FindOwner(ptr);
+			if (heap == nullptr)
+				return;
+
+			HeapFree(&heap->ctl, ptr);
+		}
+
+		KEEP void Profile(size_t *used, size_t *total, size_t *blocks)
+		{
+			HeapProfile(&routes[Tag_General]->ctl, used, total, blocks);
+		}
+
+		KEEP void Profile(Heap *heap, size_t *used, size_t *total, size_t *blocks)
+		{
+			HeapProfile(&heap->ctl, used, total, blocks);
+		}
+
+		KEEP void GetStats(Heap *heap, Stats *stats)
+		{
+			HeapStats(&heap->ctl, stats);
+		}
+
+		KEEP void ResetPeak(Heap *heap)
+		{
+			OS::DisableIRQ();
+			HeapResetPeak(&heap->ctl);
+			OS::EnableIRQ();
+		}
+
+		KEEP void SetCaller(void *ptr, const void *caller)
+		{
+			if (ptr != nullptr)
+				HeapSetCaller(ptr, caller);
+		}
+
+		// Heap report
+		static constexpr unsigned REPORT_HIST_COUNT = 24;
+		#ifdef CKSDK_MEM_DEBUG
+		static constexpr unsigned REPORT_CALLER_MAX = 64;
+		static constexpr unsigned REPORT_CALLER_TOP = 8;
+
+		static struct ReportCaller
+		{
+			const void *caller;
+			size_t blocks, bytes;
+		} report_callers[REPORT_CALLER_MAX];
+		#endif
+
+		static void OutStat(const char *label, size_t value)
+		{
+			TTY::Out(label);
+			TTY::OutHex<4>(value);
+		}
+
+		KEEP void Report(Heap *heap)
+		{
+			Stats stats;
+			HeapStats(&heap->ctl, &stats);
+
+			// Walk heap, binning free blocks by power of 2 size
+			size_t hist_count[REPORT_HIST_COUNT] = {};
+			size_t hist_bytes[REPORT_HIST_COUNT] = {};
+			#ifdef CKSDK_MEM_DEBUG
+			unsigned caller_count = 0;
+			size_t other_bytes = 0;
+			#endif
+
+			OS::DisableIRQ();
+			HeapWalk(&heap->ctl, heap->start, [&](size_t size, bool free, const void *caller)
+			{
+				if (free)
+				{
+					unsigned i = 31 - __builtin_clz(size);
+					if (i >= REPORT_HIST_COUNT)
+						i = REPORT_HIST_COUNT - 1;
+					hist_count[i]++;
+					hist_bytes[i] += size;
+					return;
+				}
+
+				#ifdef CKSDK_MEM_DEBUG
+				// Total up the memory held by each caller
+				unsigned i = 0;
+				while (i < caller_count && report_callers[i].caller != caller)
+					i++;
+				if (i == caller_count)
+				{
+					if (caller_count == REPORT_CALLER_MAX)
+					{
+						other_bytes += size;
+						return;
+					}
+					report_callers[caller_count++] = { caller, 0, 0 };
+				}
+				report_callers[i].blocks++;
+				report_callers[i].bytes += size;
+				#else
+				(void)caller;
+				#endif
+			});
+			OS::EnableIRQ();
+
+			// Output statistics
+			TTY::Out("Mem heap ");
+			TTY::Out(heap->name);
+			OutStat("\n used ", stats.used);
+			OutStat(" total ", stats.total);
+			OutStat(" peak ", stats.peak);
+			OutStat("\n blocks ", stats.blocks);
+			OutStat(" free blocks ", stats.free_blocks);
+			OutStat(" largest free ", stats.largest_free);
+			TTY::Out("\n free block sizes:\n");
+
+			for (unsigned i = 0; i < REPORT_HIST_COUNT; i++)
+			{
+				if (hist_count[i] == 0)
+					continue;
+				OutStat("  >= ", size_t(1) << i);
+				OutStat(" count ", hist_count[i]);
+				OutStat(" bytes ", hist_bytes[i]);
+				TTY::Out("\n");
+			}
+
+			#ifdef CKSDK_MEM_DEBUG
+			// Output the callers holding the most memory
+			TTY::Out(" top callers:\n");
+			for (unsigned n = 0; n < REPORT_CALLER_TOP; n++)
+			{
+				ReportCaller *top = nullptr;
+				for (unsigned i = 0; i < caller_count; i++)
+				{
+					if (report_callers[i].bytes != 0 && (top == nullptr || report_callers[i].bytes > top->bytes))
+						top = &report_callers[i];
+				}
+				if (top == nullptr)
+					break;
+
+				OutStat("  ", uintptr_t(top->caller));
+				OutStat(" blocks ", top->blocks);
+				OutStat(" bytes ", top->bytes);
+				TTY::Out("\n");
+				top->bytes = 0;
+			}
+			if (other_bytes != 0)
+			{
+				OutStat("  other bytes ", other_bytes);
+				TTY::Out("\n");
+			}
+			#endif
+		}
+
+		// Handle heap
+		struct HandleBlock
+		{
+			// Handle owning the block, or 0 if the block is a hole
+			uint16_t handle;
+			// Lock count, locked blocks are never moved
+			uint16_t lock;
+			// Size of the block including the header
+			uint32_t size;
+		};
+		static_assert(sizeof(HandleBlock) == ALIGNMENT);
+
+		static inline HandleBlock *HandleToBlock(uintptr_t ptr) { return (HandleBlock*)(ptr - sizeof(HandleBlock)); }
+
+		static inline void SetHole(char *ptr, size_t size)
+		{
+			HandleBlock *hole = (HandleBlock*)ptr;
+			hole->handle = 0;
+			hole->lock = 0;
+			hole->size = size;
+		}
+
+		KEEP void HandleHeap::Init(void *buffer, size_t size, unsigned handles)
+		{
+			// Place handle table at the start of the buffer, limited to what fits in it
+			char *bufferp = (char*)buffer;
+			char *limit = bufferp + size;
+			table = Align((uintptr_t*)buffer);
+
+			size_t fit = (limit > (char*)table) ? (size_t(limit - (char*)table) / sizeof(uintptr_t)) : 0;
+			if (handles > fit)
+				handles = fit;
+			if (handles > 0x10000)
+				handles = 0x10000;
+
+			used = 0;
+			dirty = false;
+
+			if (handles < 2)
+			{
+				// No room for a usable handle, leave an empty heap whose only handle is null
+				static uintptr_t null_table[1];
+				table = null_table;
+				free_handle = 0;
+				base = top = end = dest = scan = nullptr;
+				return;
+			}
+
+			// Use the rest of the buffer for blocks
+			base = Align((char*)(table + handles));
+			end = AlignEnd(limit);
+			if (end < base)
+				base = end;
+			top = base;
+
+			dest = scan = base;
+
+			// Link free handles, handle 0 is kept as null
+			table[0] = 0;
+			free_handle = 0;
+			for (unsigned i = handles - 1; i != 0; i--)
+			{
+				table[i] = (free_handle << 1) | 1;
+				free_handle = i;
+			}
+		}
+
+		void *HandleHeap::Search(size_t size)
+		{
+			// Holes are merged as they are searched, which would break the compactor's pass, so restart it
+			dest = scan = base;
+
+			for (char *ptr = base; ptr != top;)
+			{
+				HandleBlock *block = (HandleBlock*)ptr;
+				if (block->handle == 0)
+				{
+					// Merge following holes
+					char *next;
+					while ((next = ptr + block->size) != top && ((HandleBlock*)next)->handle == 0)
+						block->size += ((HandleBlock*)next)->size;
+
+					if (next == top)
+					{
+						// Holes at the end of the heap are returned to the free space there
+						top = ptr;
+						if (size > size_t(end - top))
+							return nullptr;
+						top += size;
+						block->size = size;
+						return block;
+					}
+
+					if (block->size >= size)
+					{
+						// Split the remainder off as a new hole
+						if (block->size != size)
+							SetHole(ptr + size, block->size - size);
+						block->size = size;
+						return block;
+					}
+				}
+				ptr += block->size;
+			}
+			return nullptr;
+		}
+
+		KEEP Handle HandleHeap::Alloc(size_t size)
+		{
+			// Get block size
+			if (free_handle == 0 || size > size_t(end - base))
+				return 0;
+			size = Align(size) + sizeof(HandleBlock);
+
+			// Take memory from the end of the heap, or search for a hole
+			HandleBlock *block;
+			if (size <= size_t(end - top))
+			{
+				block = (HandleBlock*)top;
+				block->size = size;
+				top += size;
+			}
+			else if ((block = (HandleBlock*)Search(size)) == nullptr)
+			{
+				return 0;
+			}
+			used += block->size;
+
+			// Assign handle
+			Handle handle = free_handle;
+			free_handle = table[handle] >> 1;
+
+			block->handle = handle;
+			block->lock = 0;
+			table[handle] = uintptr_t(block + 1);
+			return handle;
+		}
+
+		KEEP void HandleHeap::Free(Handle handle)
+		{
+			// Get block
+			if (handle == 0)
+				return;
+			HandleBlock *block = HandleToBlock(table[handle]);
+			used -= block->size;
+
+			// Release block, returning it to the free space if it's at the end of the heap
+			if (((char*)block + block->size) == top)
+			{
+				top = (char*)block;
+				if (scan > top)
+					dest = scan = top;
+			}
+			else
+			{
+				block->handle = 0;
+				block->lock = 0;
+			}
+			dirty = true;
+
+			// Release handle
+			table[handle] = (free_handle << 1) | 1;
+			free_handle = handle;
+		}
+
+		KEEP size_t HandleHeap::Size(Handle handle) const
+		{
+			if (handle == 0)
+				return 0;
+			return HandleToBlock(table[handle])->size - sizeof(HandleBlock);
+		}
+
+		KEEP void HandleHeap::Lock(Handle handle)
+		{
+			if (handle == 0)
+				return;
+			HandleToBlock(table[handle])->lock++;
+		}
+
+		KEEP void HandleHeap::Unlock(Handle handle)
+		{
+			if (handle == 0)
+				return;
+			HandleToBlock(table[handle])->lock--;
+		}
+
+		KEEP size_t HandleHeap::Compact(size_t budget)
+		{
+			// Slide blocks down over holes until the budget is used up
+			// Between dest and scan is a single hole, everything before dest has been compacted in this pass
+			size_t moved = 0, cost = 0;
+			while (cost < budget)
+			{
+				if (scan == top)
+				{
+					// Pass complete, the hole at the end of the heap becomes free space
+					top = scan = dest;
+
+					// Start another pass if anything was freed during this one
+					if (!dirty)
+						break;
+					dirty = false;
+					dest = scan = base;
+					continue;
+				}
+
+				HandleBlock *block = (HandleBlock*)scan;
+				size_t size = block->size;
+				if (block->handle != 0)
+				{
+					if (block->lock != 0)
+					{
+						// Locked blocks stay put, the next hole starts after them
+						dest = scan;
+					}
+					else if (dest != scan)
+					{
+						// Move block and its handle down
+						__builtin_memmove(dest, scan, size);
+						table[((HandleBlock*)dest)->handle] = uintptr_t(dest + sizeof(HandleBlock));
+						moved += size;
+						cost += size;
+					}
+					dest += size;
+				}
+				scan += size;
+				cost += sizeof(HandleBlock);
+
+				// Keep the hole between dest and scan walkable
+				if (dest != scan)
+					SetHole(dest, scan - dest);
+			}
+			return moved;
+		}
+
+		KEEP void HandleHeap::Profile(size_t *used, size_t *total, size_t *contiguous) const
+		{
+			if (used != nullptr)
+				*used = this->used;
+			if (total != nullptr)
+				*total = end - base;
+			if (contiguous != nullptr)
+				*contiguous = end - top;
+		}
+
+		namespace FrameArena
+		{
+			// Frame arena globals
+			KEEP char *g_ptr;
+			KEEP char *g_end;
+
+			static char *buffers[2];
+			static size_t buffer_size;
+			static unsigned buffer_index;
+
+			// Frame arena functions
+			KEEP void SetBuffer(void *buffer, size_t size)
+			{
+				// Setup buffers
+				char *bufferp = Align((char*)buffer);
+				size_t pad = bufferp - (char*)buffer;
+				size = (buffer == nullptr || size < pad) ? 0 : AlignEnd((size - pad) >> 1);
+
+				for (auto &i : buffers)
+				{
+					i = bufferp;
+					bufferp += size;
+				}
+				buffer_size = size;
+
+				// Use first buffer
+				buffer_index = 0;
+				g_ptr = buffers[0];
+				g_end = buffers[0] + size;
+			}
+
+			KEEP void Flip()
+			{
+				// Flip and reset buffer
+				char *bufferp = buffers[buffer_index ^= 1];
+				g_ptr = bufferp;
+				g_end = bufferp + buffer_size;
+			}
+
+			KEEP void Profile(size_t *used, size_t *total)
+			{
+				if (used != nullptr)
+					*used = g_ptr - buffers[buffer_index];
+				if (total != nullptr)
+					*total = buffer_size;
+			}
+		}
+
+		namespace Scratch
+		{
+			// Scratch globals
+			KEEP char *g_ptr;
+			KEEP char *g_end;
+
+			// Scratch functions
+			KEEP void Init()
+			{
+				// Use the scratchpad after the scratchpad section
+				g_ptr = __scratchpad_end;
+				g_end = (char*)(OS::ScratchpadBase + OS::ScratchpadSize);
+			}
+		}
 	}
 }
@@ -0,0 +1,40 @@
+# [ CKSDK ]
+# Copyright 2023 Regan "CKDEV" Green
+# 
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+# ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+# WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+# ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+# OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+.set noreorder
+
+# void CKSDK_Mem_ScratchCall(void (*func)(void*), void *arg, void *sp);
+.section .text.CKSDK_Mem_ScratchCall
+.global CKSDK_Mem_ScratchCall
+.type CKSDK_Mem_ScratchCall, @function
+CKSDK_Mem_ScratchCall:
+	# Setup frame on the new stack
+	# 16 bytes of argument space for the callee, then the old stack pointer and return address
+	addiu $a2, -24
+	sw    $sp, 16($a2)
+	sw    $ra, 20($a2)
+
+	# Switch stack and call function
+	# T9 must be set before calling the function as it's used for local addressing for DLLs
+	move  $sp, $a2
+	move  $t9, $a0
+	jalr  $t9
+	move  $a0, $a1
+
+	# Restore stack and return
+	lw    $ra, 20($sp)
+	lw    $sp, 16($sp)
+	jr    $ra
+	nop
@@ -213,5 +213,33 @@ namespace CKSDK
 		{
 			FlushCache_copy();
 		}
+
+		KEEP size_t RamInstalled()
+		{
+			// Get the size of the RAM window, accesses past it raise bus errors
+			static constexpr uint8_t window_mib[8] = { 1, 4, 1, 4, 2, 8, 2, 8 };
+			size_t window = size_t(window_mib[(OS::RamSize() >> 9) & 7]) << 20;
+
+			// RAM mirrors across the window, so find where writes start to alias a probe word
+			// The probe is accessed uncached so the writes can't be satisfied by the data cache
+			static uint32_t probe;
+			volatile uint32_t *base = (volatile uint32_t*)((uintptr_t)&probe | 0xA0000000);
+
+			size_t size = 0x200000;
+			for (; size < window; size <<= 1)
+			{
+				volatile uint32_t *mirror = (volatile uint32_t*)((uintptr_t)base + size);
+				uint32_t save = *mirror;
+
+				*base = 0x600DF00D;
+				*mirror = ~0x600DF00D;
+				bool mirrored = *base != 0x600DF00D;
+				*mirror = save;
+
+				if (mirrored)
+					break;
+			}
+			return size;
+		}
 	}
 }
@@ -0,0 +1,589 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "GP0Sim.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace GP0Sim
+{
+	// GP0 command constants
+	static constexpr uint32_t POLYLINE_TERMINATOR_MASK = 0xF000F000;
+	static constexpr uint32_t POLYLINE_TERMINATOR = 0x50005000;
+
+	// Largest polygon and line extents the GPU draws
+	static constexpr int MAX_DX = 1023;
+	static constexpr int MAX_DY = 511;
+
+	static int SignExtend11(uint32_t x)
+	{
+		return int32_t(x << 21) >> 21;
+	}
+
+	static uint16_t To15(int r, int g, int b)
+	{
+		return uint16_t((r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10));
+	}
+
+	// Interpreter functions
+	void Interpreter::Reset()
+	{
+		for (auto &i : vram)
+			for (auto &j : i)
+				j = 0;
+		cost = Cost();
+
+		cmd_length = 0;
+		polyline = false;
+		transfer_i = transfer_size = 0;
+
+		tpage = 0;
+		tex_mask_x = tex_mask_y = tex_off_x = tex_off_y = 0;
+		area_x0 = area_y0 = 0;
+		area_x1 = VRAM_WIDTH - 1;
+		area_y1 = VRAM_HEIGHT - 1;
+		offset_x = offset_y = 0;
+		set_mask = check_mask = false;
+	}
+
+	unsigned Interpreter::CommandLength(uint32_t word)
+	{
+		unsigned op = word >> 24;
+		bool grad = op & 0x10;
+		bool tex = op & 0x04;
+
+		switch (op >> 5)
+		{
+			case 0: // Misc
+				return (op == 0x02) ? 3 : 1;
+			case 1: // Polygon
+			{
+				unsigned n = (op & 0x08) ? 4 : 3;
+				return 1 + n * (tex ? 2 : 1) + (grad ? (n - 1) : 0);
+			}
+			case 2: // Line, poly-lines are received word by word
+				if (op & 0x08)
+					return 0;
+				return grad ? 4 : 3;
+			case 3: // Rectangle
+				return 2 + (tex ? 1 : 0) + (((op >> 3) & 3) == 0 ? 1 : 0);
+			case 4: // VRAM to VRAM
+				return 4;
+			case 5: // CPU to VRAM
+			case 6: // VRAM to CPU
+				return 3;
+			default: // Environment
+				return 1;
+		}
+	}
+
+	void Interpreter::Write(uint32_t word)
+	{
+		if (transfer_i < transfer_size)
+		{
+			TransferWord(word);
+			return;
+		}
+		if (polyline)
+		{
+			PolyLineWord(word);
+			return;
+		}
+
+		if (cmd_length == 0)
+		{
+			cmd_needed = CommandLength(word);
+			if (cmd_needed == 0)
+			{
+				// Start a poly-line
+				cmd[0] = word;
+				polyline = true;
+				polyline_words = 0;
+				return;
+			}
+		}
+
+		cmd[cmd_length++] = word;
+		if (cmd_length >= cmd_needed)
+		{
+			Execute();
+			cmd_length = 0;
+		}
+	}
+
+	Interpreter::Vertex Interpreter::MakeVertex(uint32_t xy, uint32_t color) const
+	{
+		Vertex v;
+		v.x = SignExtend11(xy) + offset_x;
+		v.y = SignExtend11(xy >> 16) + offset_y;
+		v.r = (color >> 0) & 0xFF;
+		v.g = (color >> 8) & 0xFF;
+		v.b = (color >> 16) & 0xFF;
+		v.u = v.v = 0;
+		return v;
+	}
+
+	Interpreter::Texture Interpreter::GetTexture(uint32_t clut) const
+	{
+		Texture texture;
+		texture.x = (tpage & 0xF) * 64;
+		texture.y = ((tpage >> 4) & 1) * 256;
+		texture.bpp = (tpage >> 7) & 3;
+		texture.clut_x = (clut & 0x3F) * 16;
+		texture.clut_y = (clut >> 6) & 0x1FF;
+		return texture;
+	}
+
+	uint16_t Interpreter::Sample(const Texture &texture, unsigned u, unsigned v)
+	{
+		// Apply the texture window
+		u = ((u & ~(tex_mask_x * 8)) | ((tex_off_x & tex_mask_x) * 8)) & 0xFF;
+		v = ((v & ~(tex_mask_y * 8)) | ((tex_off_y & tex_mask_y) * 8)) & 0xFF;
+		unsigned y = (texture.y + v) % VRAM_HEIGHT;
+
+		// Indexed textures read the CLUT too
+		unsigned index;
+		switch (texture.bpp)
+		{
+			case 0:
+				index = (vram[y][(texture.x + u / 4) % VRAM_WIDTH] >> ((u & 3) * 4)) & 0xF;
+				break;
+			case 1:
+				index = (vram[y][(texture.x + u / 2) % VRAM_WIDTH] >> ((u & 1) * 8)) & 0xFF;
+				break;
+			default:
+				cost.texels++;
+				return vram[y][(texture.x + u) % VRAM_WIDTH];
+		}
+		cost.texels += 2;
+		return vram[texture.clut_y][(texture.clut_x + index) % VRAM_WIDTH];
+	}
+
+	void Interpreter::Plot(int x, int y, uint16_t color, bool semi)
+	{
+		uint16_t &dst = vram[y][x];
+		if (check_mask && (dst & 0x8000))
+			return;
+
+		if (semi)
+		{
+			// Blend each channel with the background
+			unsigned mode = (tpage >> 5) & 3;
+			uint16_t blended = color & 0x8000;
+			for (unsigned shift = 0; shift < 15; shift += 5)
+			{
+				int b = (dst >> shift) & 31;
+				int f = (color >> shift) & 31;
+				int c;
+				switch (mode)
+				{
+					case 0:
+						c = (b + f) >> 1;
+						break;
+					case 1:
+						c = b + f;
+						break;
+					case 2:
+						c = b - f;
+						break;
+					default:
+						c = b + (f >> 2);
+						break;
+				}
+				blended |= uint16_t(std::clamp(c, 0, 31) << shift);
+			}
+			color = blended;
+		}
+
+		dst = color | (set_mask ? 0x8000 : 0);
+		cost.pixels++;
+	}
+
+	void Interpreter::Shade(int x, int y, const Texture *texture, int r, int g, int b, int u, int v, bool semi, bool raw)
+	{
+		if (texture == nullptr)
+		{
+			Plot(x, y, To15(r, g, b), semi);
+			return;
+		}
+
+		// Texel 0 is transparent, and only texels with their top bit set are semi-transparent
+		uint16_t texel = Sample(*texture, u, v);
+		if (texel == 0)
+			return;
+		semi = semi && (texel & 0x8000);
+
+		if (!raw)
+		{
+			// Modulate by the color, where 0x80 is unchanged
+			int tr = std::min(((texel >> 0) & 31) * r >> 7, 31);
+			int tg = std::min(((texel >> 5) & 31) * g >> 7, 31);
+			int tb = std::min(((texel >> 10) & 31) * b >> 7, 31);
+			texel = (texel & 0x8000) | tr | (tg << 5) | (tb << 10);
+		}
+		Plot(x, y, texel, semi);
+	}
+
+	void Interpreter::Triangle(const Vertex &v0, const Vertex &v1, const Vertex &v2, bool grad, const Texture *texture, bool semi, bool raw)
+	{
+		// The GPU skips polygons that are too big
+		int min_x = std::min({v0.x, v1.x, v2.x}), max_x = std::max({v0.x, v1.x, v2.x});
+		int min_y = std::min({v0.y, v1.y, v2.y}), max_y = std::max({v0.y, v1.y, v2.y});
+		if ((max_x - min_x) > MAX_DX || (max_y - min_y) > MAX_DY)
+			return;
+
+		// Wind the triangle so inside points have positive edge functions
+		auto edge = [](const Vertex &a, const Vertex &b, int x, int y) -> int64_t
+		{
+			return int64_t(b.x - a.x) * (y - a.y) - int64_t(b.y - a.y) * (x - a.x);
+		};
+
+		const Vertex *p0 = &v0, *p1 = &v1, *p2 = &v2;
+		int64_t area = edge(*p0, *p1, p2->x, p2->y);
+		if (area == 0)
+			return;
+		if (area < 0)
+		{
+			std::swap(p1, p2);
+			area = -area;
+		}
+
+		// Points on an edge are only drawn for top and left edges, so shared edges aren't drawn twice
+		auto owns = [](const Vertex &a, const Vertex &b) -> bool
+		{
+			int dy = b.y - a.y;
+			return dy < 0 || (dy == 0 && (b.x - a.x) > 0);
+		};
+		bool own0 = owns(*p1, *p2), own1 = owns(*p2, *p0), own2 = owns(*p0, *p1);
+
+		// Scan the bounding box within the draw area
+		min_x = std::max(min_x, area_x0);
+		max_x = std::min(max_x, area_x1);
+		min_y = std::max(min_y, area_y0);
+		max_y = std::min(max_y, area_y1);
+
+		for (int y = min_y; y <= max_y; y++)
+		{
+			for (int x = min_x; x <= max_x; x++)
+			{
+				int64_t w0 = edge(*p1, *p2, x, y);
+				int64_t w1 = edge(*p2, *p0, x, y);
+				int64_t w2 = edge(*p0, *p1, x, y);
+				if (w0 < 0 || w1 < 0 || w2 < 0)
+					continue;
+				if ((w0 == 0 && !own0) || (w1 == 0 && !own1) || (w2 == 0 && !own2))
+					continue;
+
+				auto lerp = [&](int a0, int a1, int a2) -> int
+				{
+					return int((w0 * a0 + w1 * a1 + w2 * a2) / area);
+				};
+
+				int r = p0->r, g = p0->g, b = p0->b;
+				if (grad)
+				{
+					r = lerp(p0->r, p1->r, p2->r);
+					g = lerp(p0->g, p1->g, p2->g);
+					b = lerp(p0->b, p1->b, p2->b);
+				}
+
+				int u = 0, v = 0;
+				if (texture != nullptr)
+				{
+					u = lerp(p0->u, p1->u, p2->u);
+					v = lerp(p0->v, p1->v, p2->v);
+				}
+
+				Shade(x, y, texture, r, g, b, u, v, semi, raw);
+			}
+		}
+	}
+
+	void Interpreter::Line(Vertex v0, Vertex v1, bool grad, bool semi)
+	{
+		// The GPU skips lines that are too long
+		int dx = v1.x - v0.x, dy = v1.y - v0.y;
+		if (std::abs(dx) > MAX_DX || std::abs(dy) > MAX_DY)
+			return;
+
+		// Step along the major axis, rounding the minor axis
+		int steps = std::max(std::abs(dx), std::abs(dy));
+		for (int i = 0; i <= steps; i++)
+		{
+			int x = v0.x, y = v0.y;
+			int r = v0.r, g = v0.g, b = v0.b;
+			if (steps != 0)
+			{
+				x += (dx * i + (dx < 0 ? -steps : steps) / 2) / steps;
+				y += (dy * i + (dy < 0 ? -steps : steps) / 2) / steps;
+				if (grad)
+				{
+					r += (v1.r - v0.r) * i / steps;
+					g += (v1.g - v0.g) * i / steps;
+					b += (v1.b - v0.b) * i / steps;
+				}
+			}
+
+			if (x < area_x0 || x > area_x1 || y < area_y0 || y > area_y1)
+				continue;
+			Plot(x, y, To15(r, g, b), semi);
+		}
+	}
+
+	void Interpreter::Rect(const Vertex &v0, int w, int h, const Texture *texture, bool semi, bool raw)
+	{
+		// Flip bits come from the draw mode
+		int du = (tpage & (1 << 12)) ? -1 : 1;
+		int dv = (tpage & (1 << 13)) ? -1 : 1;
+
+		for (int j = 0; j < h; j++)
+		{
+			int y = v0.y + j;
+			if (y < area_y0 || y > area_y1)
+				continue;
+			for (int i = 0; i < w; i++)
+			{
+				int x = v0.x + i;
+				if (x < area_x0 || x > area_x1)
+					continue;
+				Shade(x, y, texture, v0.r, v0.g, v0.b, (v0.u + i * du) & 0xFF, (v0.v + j * dv) & 0xFF, semi, raw);
+			}
+		}
+	}
+
+	void Interpreter::PolyLineWord(uint32_t word)
+	{
+		bool grad = cmd[0] & (0x10 << 24);
+		bool semi = cmd[0] & (0x02 << 24);
+
+		// Gradient poly-lines alternate colors and points after the first point
+		unsigned pos = polyline_words++;
+		unsigned vertex = grad ? ((pos + 1) / 2) : pos;
+		bool vertex_start = !grad || pos == 0 || (pos & 1);
+
+		// The terminator can only come after the first two points
+		if (vertex_start && vertex >= 2 && (word & POLYLINE_TERMINATOR_MASK) == POLYLINE_TERMINATOR)
+		{
+			polyline = false;
+			cost.commands++;
+			return;
+		}
+
+		if (grad && (pos & 1))
+		{
+			polyline_color = word;
+			return;
+		}
+
+		Vertex v = MakeVertex(word, (grad && vertex != 0) ? polyline_color : cmd[0]);
+		if (vertex != 0)
+			Line(polyline_last, v, grad, semi);
+		polyline_last = v;
+	}
+
+	void Interpreter::TransferWord(uint32_t word)
+	{
+		// Each word holds two pixels, the second is ignored if the transfer is an odd size
+		for (unsigned i = 0; i < 2 && transfer_i < transfer_size; i++, transfer_i++, word >>= 16)
+		{
+			unsigned x = (transfer_x + transfer_i % transfer_w) % VRAM_WIDTH;
+			unsigned y = (transfer_y + transfer_i / transfer_w) % VRAM_HEIGHT;
+			uint16_t &dst = vram[y][x];
+			if (check_mask && (dst & 0x8000))
+				continue;
+			dst = uint16_t(word) | (set_mask ? 0x8000 : 0);
+			cost.pixels++;
+		}
+	}
+
+	void Interpreter::Execute()
+	{
+		uint32_t word = cmd[0];
+		unsigned op = word >> 24;
+		cost.commands++;
+
+		switch (op >> 5)
+		{
+			case 0: // Misc
+			{
+				if (op == 0x02)
+				{
+					// Fill ignores the draw area, offset and mask, and works in 16 pixel columns
+					unsigned x = cmd[1] & 0x3F0, y = (cmd[1] >> 16) & 0x1FF;
+					unsigned w = ((cmd[2] & 0x3FF) + 15) & ~15, h = (cmd[2] >> 16) & 0x1FF;
+					uint16_t color = To15(word & 0xFF, (word >> 8) & 0xFF, (word >> 16) & 0xFF);
+					for (unsigned j = 0; j < h; j++)
+						for (unsigned i = 0; i < w; i++)
+							vram[(y + j) % VRAM_HEIGHT][(x + i) % VRAM_WIDTH] = color;
+					cost.pixels += w * h;
+				}
+				else if (op > 0x02 && op != 0x1F)
+				{
+					cost.unknown++;
+				}
+				break;
+			}
+			case 1: // Polygon
+			{
+				bool grad = op & 0x10, quad = op & 0x08, tex = op & 0x04, semi = op & 0x02, raw = op & 0x01;
+				unsigned n = quad ? 4 : 3;
+
+				Vertex v[4];
+				uint32_t clut = 0;
+				const uint32_t *wordp = &cmd[1];
+				for (unsigned i = 0; i < n; i++)
+				{
+					uint32_t color = (grad && i != 0) ? *wordp++ : word;
+					v[i] = MakeVertex(*wordp++, color);
+					if (tex)
+					{
+						uint32_t uv = *wordp++;
+						v[i].u = uv & 0xFF;
+						v[i].v = (uv >> 8) & 0xFF;
+						if (i == 0)
+							clut = uv >> 16;
+						else if (i == 1)
+							tpage = (tpage & ~0x9FFU) | ((uv >> 16) & 0x9FF);
+					}
+				}
+
+				Texture texture;
+				if (tex)
+					texture = GetTexture(clut);
+				Triangle(v[0], v[1], v[2], grad, tex ? &texture : nullptr, semi, raw);
+				if (quad)
+					Triangle(v[1], v[2], v[3], grad, tex ? &texture : nullptr, semi, raw);
+				break;
+			}
+			case 2: // Line
+			{
+				bool grad = op & 0x10, semi = op & 0x02;
+				Vertex v0 = MakeVertex(cmd[1], word);
+				Vertex v1 = grad ? MakeVertex(cmd[3], cmd[2]) : MakeVertex(cmd[2], word);
+				Line(v0, v1, grad, semi);
+				break;
+			}
+			case 3: // Rectangle
+			{
+				bool tex = op & 0x04, semi = op & 0x02, raw = op & 0x01;
+				unsigned size = (op >> 3) & 3;
+
+				Vertex v0 = MakeVertex(cmd[1], word);
+				uint32_t clut = 0;
+				unsigned i = 2;
+				if (tex)
+				{
+					v0.u = cmd[i] & 0xFF;
+					v0.v = (cmd[i] >> 8) & 0xFF;
+					clut = cmd[i] >> 16;
+					i++;
+				}
+
+				int w, h;
+				switch (size)
+				{
+					case 0:
+						w = cmd[i] & 0x3FF;
+						h = (cmd[i] >> 16) & 0x1FF;
+						break;
+					case 1:
+						w = h = 1;
+						break;
+					case 2:
+						w = h = 8;
+						break;
+					default:
+						w = h = 16;
+						break;
+				}
+
+				Texture texture;
+				if (tex)
+					texture = GetTexture(clut);
+				Rect(v0, w, h, tex ? &texture : nullptr, semi, raw);
+				break;
+			}
+			case 4: // VRAM to VRAM
+			{
+				unsigned sx = cmd[1] & 0x3FF, sy = (cmd[1] >> 16) & 0x1FF;
+				unsigned dx = cmd[2] & 0x3FF, dy = (cmd[2] >> 16) & 0x1FF;
+				unsigned w = ((cmd[3] - 1) & 0x3FF) + 1, h = (((cmd[3] >> 16) - 1) & 0x1FF) + 1;
+				for (unsigned j = 0; j < h; j++)
+				{
+					for (unsigned i = 0; i < w; i++)
+					{
+						uint16_t src = vram[(sy + j) % VRAM_HEIGHT][(sx + i) % VRAM_WIDTH];
+						uint16_t &dst = vram[(dy + j) % VRAM_HEIGHT][(dx + i) % VRAM_WIDTH];
+						if (check_mask && (dst & 0x8000))
+							continue;
+						dst = src | (set_mask ? 0x8000 : 0);
+						cost.pixels++;
+					}
+				}
+				break;
+			}
+			case 5: // CPU to VRAM, the pixels follow the command
+			{
+				transfer_x = cmd[1] & 0x3FF;
+				transfer_y = (cmd[1] >> 16) & 0x1FF;
+				transfer_w = ((cmd[2] - 1) & 0x3FF) + 1;
+				transfer_h = (((cmd[2] >> 16) - 1) & 0x1FF) + 1;
+				transfer_i = 0;
+				transfer_size = transfer_w * transfer_h;
+				break;
+			}
+			case 6: // VRAM to CPU, which sends nothing more through GP0
+				break;
+			default: // Environment
+			{
+				switch (op)
+				{
+					case 0xE1:
+						tpage = word & 0x3FFF;
+						break;
+					case 0xE2:
+						tex_mask_x = (word >> 0) & 0x1F;
+						tex_mask_y = (word >> 5) & 0x1F;
+						tex_off_x = (word >> 10) & 0x1F;
+						tex_off_y = (word >> 15) & 0x1F;
+						break;
+					case 0xE3:
+						area_x0 = word & 0x3FF;
+						area_y0 = std::min<int>((word >> 10) & 0x3FF, VRAM_HEIGHT - 1);
+						break;
+					case 0xE4:
+						area_x1 = word & 0x3FF;
+						area_y1 = std::min<int>((word >> 10) & 0x3FF, VRAM_HEIGHT - 1);
+						break;
+					case 0xE5:
+						offset_x = SignExtend11(word);
+						offset_y = SignExtend11(word >> 11);
+						break;
+					case 0xE6:
+						set_mask = word & 1;
+						check_mask = word & 2;
+						break;
+					default:
+						cost.unknown++;
+						break;
+				}
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,137 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+// Host GP0 interpreter and software rasterizer
+// Commands are rasterized into a 1024x512 VRAM image, counting what each packet costs as they go
+// Rasterization follows the GPU's rules closely enough to catch malformed packets, but isn't bit exact (no dithering, and polygon edges may differ by a pixel)
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace GP0Sim
+{
+	// VRAM constants
+	static constexpr unsigned VRAM_WIDTH = 1024;
+	static constexpr unsigned VRAM_HEIGHT = 512;
+
+	// Cost of a run of commands
+	struct Cost
+	{
+		uint32_t commands = 0; // Commands executed
+		uint32_t pixels = 0;   // Pixels written to VRAM
+		uint32_t texels = 0;   // Texels fetched, including CLUT reads
+		uint32_t unknown = 0;  // Words that weren't a known command
+
+		Cost &operator+=(const Cost &o)
+		{
+			commands += o.commands;
+			pixels += o.pixels;
+			texels += o.texels;
+			unknown += o.unknown;
+			return *this;
+		}
+	};
+
+	// GP0 interpreter
+	class Interpreter
+	{
+		public:
+			// VRAM, 15-bit BGR with the mask bit on top
+			uint16_t vram[VRAM_HEIGHT][VRAM_WIDTH];
+
+			// Cost since the last call to TakeCost
+			Cost cost;
+
+		private:
+			// Command being received
+			uint32_t cmd[16];
+			unsigned cmd_length = 0, cmd_needed = 0;
+
+			// Poly-line being received
+			bool polyline = false;
+			unsigned polyline_words = 0;
+			uint32_t polyline_color = 0;
+
+			// CPU to VRAM transfer being received
+			unsigned transfer_x = 0, transfer_y = 0, transfer_w = 0, transfer_h = 0;
+			unsigned transfer_i = 0, transfer_size = 0;
+
+			// Draw mode
+			unsigned tpage = 0;
+			unsigned tex_mask_x = 0, tex_mask_y = 0, tex_off_x = 0, tex_off_y = 0;
+			int area_x0 = 0, area_y0 = 0, area_x1 = 0, area_y1 = 0;
+			int offset_x = 0, offset_y = 0;
+			bool set_mask = false, check_mask = false;
+
+			// Vertex used by the rasterizer
+			struct Vertex
+			{
+				int x, y;
+				int r, g, b;
+				int u, v;
+			};
+
+			// Texture being sampled
+			struct Texture
+			{
+				unsigned x, y, bpp;
+				unsigned clut_x, clut_y;
+			};
+
+			// Last vertex of the poly-line being received
+			Vertex polyline_last = {};
+
+			static unsigned CommandLength(uint32_t word);
+			void Execute();
+
+			Vertex MakeVertex(uint32_t xy, uint32_t color) const;
+			Texture GetTexture(uint32_t clut) const;
+			uint16_t Sample(const Texture &texture, unsigned u, unsigned v);
+
+			void Plot(int x, int y, uint16_t color, bool semi);
+			void Shade(int x, int y, const Texture *texture, int r, int g, int b, int u, int v, bool semi, bool raw);
+			void Triangle(const Vertex &v0, const Vertex &v1, const Vertex &v2, bool grad, const Texture *texture, bool semi, bool raw);
+			void Line(Vertex v0, Vertex v1, bool grad, bool semi);
+			void Rect(const Vertex &v0, int w, int h, const Texture *texture, bool semi, bool raw);
+
+			void PolyLineWord(uint32_t word);
+			void TransferWord(uint32_t word);
+
+		public:
+			// Interpreter functions
+			Interpreter() { Reset(); }
+
+			// Clears VRAM and the GPU state
+			void Reset();
+
+			// Writes a word to GP0
+			void Write(uint32_t word);
+
+			// Checks if a command is partly received
+			bool Busy() const { return cmd_length != 0 || polyline || transfer_i < transfer_size; }
+
+			// Takes the cost since the last call
+			Cost TakeCost()
+			{
+				Cost taken = cost;
+				cost = Cost();
+				return taken;
+			}
+	};
+}
@@ -0,0 +1,354 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+// usage: GP0Sim [options] out.png
+//  -v vram.bin          loads VRAM (1024x512 16-bit pixels) before running
+//  -r ram.bin address   walks the Tag chain starting at address in a main RAM dump
+//  -c cmds.bin          runs a raw stream of GP0 words, such as a Queue_CommandDMA buffer
+//  -o vram.bin          saves VRAM after running
+//  -p                   prints the cost of each packet
+// Inputs run in the order given. A chain is usually dumped from an emulator along with the address of the Tag returned by Buffer::Link.
+// Packets that split a command, don't fit the GP0 FIFO, or contain unknown commands are reported, and make the tool return 1.
+
+#include "GP0Sim.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+
+// GP0 constants
+static constexpr size_t GP0_FIFO_WORDS = 16;
+static constexpr uint32_t TAG_END = 0x800000;
+static constexpr size_t PACKET_LIMIT = 1 << 20;
+
+static GP0Sim::Interpreter interpreter;
+static bool print_packets = false;
+static unsigned warnings = 0;
+
+// File helpers
+static bool ReadFile(const char *path, std::vector<uint8_t> &data)
+{
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in)
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+	data.resize(in.tellg());
+	in.seekg(0);
+	in.read((char*)data.data(), data.size());
+	return true;
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static void Put32BE(std::vector<uint8_t> &data, uint32_t x)
+{
+	data.push_back(x >> 24);
+	data.push_back(x >> 16);
+	data.push_back(x >> 8);
+	data.push_back(x >> 0);
+}
+
+// Cost output
+static void OutCost(const GP0Sim::Cost &cost)
+{
+	std::cout << " commands " << cost.commands << " pixels " << cost.pixels << " texels " << cost.texels;
+	if (cost.unknown != 0)
+		std::cout << " unknown " << cost.unknown;
+}
+
+static void Warn(uint32_t addr, const char *message)
+{
+	std::cerr << "packet " << std::hex << addr << std::dec << ": " << message << std::endl;
+	warnings++;
+}
+
+// Inputs
+static bool RunChain(const char *path, uint32_t addr, GP0Sim::Cost &total)
+{
+	std::vector<uint8_t> ram;
+	if (!ReadFile(path, ram))
+		return false;
+
+	// Walk the chain, addresses are within main RAM whatever segment they're in
+	addr &= 0xFFFFFF;
+	size_t packets = 0;
+	while ((addr & TAG_END) == 0)
+	{
+		if (++packets > PACKET_LIMIT)
+		{
+			std::cerr << "Tag chain doesn't end, it probably loops" << std::endl;
+			return false;
+		}
+
+		size_t offset = addr & 0x1FFFFC;
+		if (offset + 4 > ram.size())
+		{
+			std::cerr << "Tag " << std::hex << addr << std::dec << " is outside the RAM dump" << std::endl;
+			return false;
+		}
+		uint32_t tag = Get32(&ram[offset]);
+		size_t words = tag >> 24;
+		if (offset + 4 + words * 4 > ram.size())
+		{
+			std::cerr << "Packet " << std::hex << addr << std::dec << " is outside the RAM dump" << std::endl;
+			return false;
+		}
+
+		// Run the packet's words
+		for (size_t i = 0; i < words; i++)
+			interpreter.Write(Get32(&ram[offset + 4 + i * 4]));
+
+		GP0Sim::Cost cost = interpreter.TakeCost();
+		total += cost;
+		if (words > GP0_FIFO_WORDS)
+			Warn(addr, "packet doesn't fit the GP0 FIFO");
+		if (interpreter.Busy())
+			Warn(addr, "packet ends in the middle of a command");
+		if (cost.unknown != 0)
+			Warn(addr, "packet contains unknown commands");
+
+		if (print_packets && words != 0)
+		{
+			std::cout << "packet " << std::hex << addr << std::dec << " words " << words;
+			OutCost(cost);
+			std::cout << std::endl;
+		}
+
+		addr = tag & 0xFFFFFF;
+	}
+	return true;
+}
+
+static bool RunCommands(const char *path, GP0Sim::Cost &total)
+{
+	std::vector<uint8_t> data;
+	if (!ReadFile(path, data))
+		return false;
+
+	for (size_t i = 0; i + 4 <= data.size(); i += 4)
+		interpreter.Write(Get32(&data[i]));
+
+	GP0Sim::Cost cost = interpreter.TakeCost();
+	total += cost;
+	if (interpreter.Busy())
+	{
+		std::cerr << path << ": ends in the middle of a command" << std::endl;
+		warnings++;
+	}
+	if (cost.unknown != 0)
+	{
+		std::cerr << path << ": contains unknown commands" << std::endl;
+		warnings++;
+	}
+	return true;
+}
+
+// VRAM files
+static bool LoadVRAM(const char *path)
+{
+	std::vector<uint8_t> data;
+	if (!ReadFile(path, data))
+		return false;
+	if (data.size() != sizeof(interpreter.vram))
+	{
+		std::cerr << "VRAM dump must be " << sizeof(interpreter.vram) << " bytes" << std::endl;
+		return false;
+	}
+
+	const uint8_t *p = data.data();
+	for (auto &i : interpreter.vram)
+		for (auto &j : i)
+			j = uint16_t(p[0] | (p[1] << 8)), p += 2;
+	return true;
+}
+
+static bool SaveVRAM(const char *path)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+	for (auto &i : interpreter.vram)
+	{
+		for (auto &j : i)
+		{
+			char p[2] = {char(j & 0xFF), char(j >> 8)};
+			out.write(p, 2);
+		}
+	}
+	return true;
+}
+
+// PNG output
+// Image data is stored uncompressed, so no zlib is needed
+static uint32_t crc_table[256];
+
+static void InitCRC()
+{
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+		crc_table[i] = c;
+	}
+}
+
+static void WriteChunk(std::ofstream &out, const char *type, const std::vector<uint8_t> &data)
+{
+	std::vector<uint8_t> chunk;
+	Put32BE(chunk, data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 4; i < chunk.size(); i++)
+		crc = crc_table[(crc ^ chunk[i]) & 0xFF] ^ (crc >> 8);
+	Put32BE(chunk, crc ^ 0xFFFFFFFF);
+
+	out.write((const char*)chunk.data(), chunk.size());
+}
+
+static bool WritePNG(const char *path)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+	InitCRC();
+
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	out.write((const char*)signature, sizeof(signature));
+
+	// 8-bit RGB
+	std::vector<uint8_t> ihdr;
+	Put32BE(ihdr, GP0Sim::VRAM_WIDTH);
+	Put32BE(ihdr, GP0Sim::VRAM_HEIGHT);
+	ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0});
+	WriteChunk(out, "IHDR", ihdr);
+
+	// Rows of 15-bit pixels expanded to 8-bit, each with no filter
+	std::vector<uint8_t> raw;
+	for (auto &i : interpreter.vram)
+	{
+		raw.push_back(0);
+		for (auto &j : i)
+		{
+			for (unsigned shift = 0; shift < 15; shift += 5)
+			{
+				uint8_t c = (j >> shift) & 31;
+				raw.push_back((c << 3) | (c >> 2));
+			}
+		}
+	}
+
+	// zlib stream of stored deflate blocks
+	std::vector<uint8_t> idat = {0x78, 0x01};
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < raw.size();)
+	{
+		size_t size = std::min<size_t>(raw.size() - i, 0xFFFF);
+		idat.push_back((i + size == raw.size()) ? 1 : 0);
+		idat.push_back(size & 0xFF);
+		idat.push_back(size >> 8);
+		idat.push_back(~size & 0xFF);
+		idat.push_back((~size >> 8) & 0xFF);
+		for (size_t j = 0; j < size; j++, i++)
+		{
+			idat.push_back(raw[i]);
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+	}
+	Put32BE(idat, (b << 16) | a);
+	WriteChunk(out, "IDAT", idat);
+	WriteChunk(out, "IEND", {});
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	// Check arguments
+	if (argc < 2)
+	{
+		std::cout << "usage: GP0Sim [-v vram.bin] [-r ram.bin address] [-c cmds.bin] [-o vram.bin] [-p] out.png" << std::endl;
+		return 0;
+	}
+
+	// Run inputs in order
+	GP0Sim::Cost total;
+	const char *png_path = nullptr, *vram_path = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool ok = true;
+		if (arg == "-p")
+		{
+			print_packets = true;
+		}
+		else if (arg == "-v" && i + 1 < argc)
+		{
+			ok = LoadVRAM(argv[++i]);
+		}
+		else if (arg == "-r" && i + 2 < argc)
+		{
+			const char *path = argv[++i];
+			ok = RunChain(path, uint32_t(std::stoul(argv[++i], nullptr, 16)), total);
+		}
+		else if (arg == "-c" && i + 1 < argc)
+		{
+			ok = RunCommands(argv[++i], total);
+		}
+		else if (arg == "-o" && i + 1 < argc)
+		{
+			vram_path = argv[++i];
+		}
+		else if (arg[0] != '-' && png_path == nullptr)
+		{
+			png_path = argv[i];
+		}
+		else
+		{
+			std::cerr << "Invalid argument " << arg << std::endl;
+			return 1;
+		}
+		if (!ok)
+			return 1;
+	}
+
+	// Output results
+	std::cout << "total";
+	OutCost(total);
+	std::cout << " warnings " << warnings << std::endl;
+
+	if (vram_path != nullptr && !SaveVRAM(vram_path))
+		return 1;
+	if (png_path != nullptr && !WritePNG(png_path))
+		return 1;
+	return (warnings != 0) ? 1 : 0;
+}
@@ -0,0 +1,828 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+// MemBench - host benchmark and fuzz harness for the CKSDK allocator
+// usage: MemBench [-heap KiB] [-seed n] [-frames n] mode [args]
+//  game           simulates level streaming, entities, and per-frame temporaries
+//  churn          random sizes with a steady live set
+//  realloc        growing arrays interleaved with small allocations
+//  trace file     replays a trace, one operation per line:
+//                  a id size [align]   allocate
+//                  r id size           reallocate
+//                  f id                free
+//  fuzz [n]       n random operations checking data, alignment, IRQ balance and statistics,
+//                 then n on a handle heap checking data survives compaction
+//  all            runs game, churn, realloc and fuzz
+
+#include <CKSDK/Mem.h>
+#include <CKSDK/OS.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+using namespace CKSDK;
+
+// Mem.cpp expects the scratchpad section from the linker script
+extern "C"
+{
+	char __scratchpad_end[8];
+}
+
+// Heap
+static std::vector<uint64_t> heap_buffer;
+
+static void ResetHeap(size_t size)
+{
+	heap_buffer.assign(size / sizeof(uint64_t), 0);
+	Mem::Init(heap_buffer.data(), size);
+}
+
+// Benchmark state
+struct Bench
+{
+	const char *name;
+
+	// Operation counts and times
+	enum Op { Op_Alloc, Op_Realloc, Op_Free, Op_Count };
+	size_t ops[Op_Count] = {};
+	double ns[Op_Count] = {};
+
+	// Failures and fragmentation
+	size_t fails = 0;
+	double frag_max = 0.0, frag_sum = 0.0;
+	size_t frag_samples = 0;
+
+	Bench(const char *_name) : name(_name) {}
+};
+
+static double timer_overhead;
+
+static inline std::chrono::steady_clock::time_point Now() { return std::chrono::steady_clock::now(); }
+
+static void CalibrateTimer()
+{
+	// Measure the cost of timing an empty operation, so it can be taken off each measurement
+	auto start = Now();
+	for (int i = 0; i < 100000; i++)
+	{
+		auto t0 = Now();
+		auto t1 = Now();
+		(void)t0; (void)t1;
+	}
+	timer_overhead = std::chrono::duration<double, std::nano>(Now() - start).count() / 100000.0 / 2.0;
+}
+
+static void Record(Bench &bench, Bench::Op op, std::chrono::steady_clock::time_point t0)
+{
+	double ns = std::chrono::duration<double, std::nano>(Now() - t0).count() - timer_overhead;
+	bench.ops[op]++;
+	bench.ns[op] += (ns > 0.0) ? ns : 0.0;
+}
+
+static void *BenchAlloc(Bench &bench, size_t size, size_t align = 0)
+{
+	auto t0 = Now();
+	void *ptr = (align > 8) ? Mem::AllocAligned(size, align) : Mem::Alloc(size);
+	Record(bench, Bench::Op_Alloc, t0);
+	if (ptr == nullptr)
+		bench.fails++;
+	return ptr;
+}
+
+static void *BenchRealloc(Bench &bench, void *ptr, size_t size)
+{
+	auto t0 = Now();
+	void *newptr = Mem::Realloc(ptr, size);
+	Record(bench, Bench::Op_Realloc, t0);
+	if (newptr == nullptr)
+		bench.fails++;
+	return newptr;
+}
+
+static void BenchFree(Bench &bench, void *ptr)
+{
+	auto t0 = Now();
+	Mem::Free(ptr);
+	Record(bench, Bench::Op_Free, t0);
+}
+
+static void SampleFragmentation(Bench &bench)
+{
+	// Fragmentation is the share of free memory that isn't in the largest free block
+	Mem::Stats stats;
+	Mem::GetStats(Mem::GetHeap(Mem::Tag_General), &stats);
+
+	size_t free = stats.total - stats.used;
+	double frag = (free != 0) ? (1.0 - double(stats.largest_free) / double(free)) : 0.0;
+	if (frag > bench.frag_max)
+		bench.frag_max = frag;
+	bench.frag_sum += frag;
+	bench.frag_samples++;
+}
+
+static void Report(const Bench &bench)
+{
+	Mem::Stats stats;
+	Mem::GetStats(Mem::GetHeap(Mem::Tag_General), &stats);
+
+	std::printf("%-8s", bench.name);
+	static const char *op_names[] = { "alloc", "realloc", "free" };
+	for (int i = 0; i < Bench::Op_Count; i++)
+	{
+		if (bench.ops[i] != 0)
+			std::printf(" %s %8zu x %7.1fns", op_names[i], bench.ops[i], bench.ns[i] / double(bench.ops[i]));
+	}
+	std::printf("\n         fails %zu peak %zu/%zu frag avg %.1f%% max %.1f%%\n",
+		bench.fails, stats.peak, stats.total,
+		(bench.frag_samples != 0) ? (bench.frag_sum * 100.0 / double(bench.frag_samples)) : 0.0,
+		bench.frag_max * 100.0
+	);
+}
+
+// Random helpers
+static std::mt19937 rng;
+
+static size_t RandRange(size_t min, size_t max)
+{
+	return std::uniform_int_distribution<size_t>(min, max)(rng);
+}
+
+static size_t RandLog(size_t min, size_t max)
+{
+	// Log-uniform, so small sizes are as likely per octave as large ones
+	double l = std::uniform_real_distribution<double>(std::log(double(min)), std::log(double(max)))(rng);
+	return size_t(std::exp(l));
+}
+
+static unsigned RandLifetime(double mean)
+{
+	return unsigned(std::exponential_distribution<double>(1.0 / mean)(rng)) + 1;
+}
+
+// Synthetic patterns
+static void RunGame(size_t heap_size, unsigned frames)
+{
+	// Levels load long-lived assets, entities come and go, and every frame makes temporaries
+	ResetHeap(heap_size);
+	Bench bench("game");
+
+	struct Entity
+	{
+		void *data, *component;
+		unsigned death;
+	};
+
+	std::vector<void*> assets;
+	std::vector<Entity> entities;
+	std::vector<std::pair<void*, unsigned>> staging;
+	std::vector<void*> temps;
+
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		// Swap level
+		if ((frame % 3600) == 0)
+		{
+			for (void *ptr : assets)
+				BenchFree(bench, ptr);
+			assets.clear();
+
+			size_t budget = heap_size / 2;
+			for (unsigned i = RandRange(20, 60); i != 0; i--)
+			{
+				size_t size = RandLog(4096, 96 * 1024);
+				if (size > budget)
+					break;
+				budget -= size;
+				if (void *ptr = BenchAlloc(bench, size))
+					assets.push_back(ptr);
+			}
+		}
+
+		// Stream in aligned staging buffers, which live for a few frames
+		if (RandRange(0, 59) == 0)
+		{
+			if (void *ptr = BenchAlloc(bench, RandLog(2048, 32768), 64))
+				staging.push_back({ ptr, frame + RandLifetime(4) });
+		}
+		for (size_t i = 0; i < staging.size();)
+		{
+			if (staging[i].second <= frame)
+			{
+				BenchFree(bench, staging[i].first);
+				staging[i] = staging.back();
+				staging.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		// Spawn and kill entities
+		for (unsigned i = RandRange(0, 4); i != 0 && entities.size() < 2048; i--)
+		{
+			Entity entity;
+			entity.data = BenchAlloc(bench, RandLog(64, 1024));
+			entity.component = BenchAlloc(bench, RandLog(16, 256));
+			entity.death = frame + RandLifetime(300);
+			entities.push_back(entity);
+		}
+		for (size_t i = 0; i < entities.size();)
+		{
+			Entity &entity = entities[i];
+			if (entity.death <= frame)
+			{
+				BenchFree(bench, entity.component);
+				BenchFree(bench, entity.data);
+				entity = entities.back();
+				entities.pop_back();
+				continue;
+			}
+
+			// Occasionally grow an entity's data, like a string or inventory
+			if (entity.data != nullptr && RandRange(0, 999) == 0)
+			{
+				if (void *ptr = BenchRealloc(bench, entity.data, RandLog(64, 2048)))
+					entity.data = ptr;
+			}
+			i++;
+		}
+
+		// Per-frame temporaries
+		for (unsigned i = RandRange(5, 20); i != 0; i--)
+			temps.push_back(BenchAlloc(bench, RandLog(16, 512)));
+		for (void *ptr : temps)
+			BenchFree(bench, ptr);
+		temps.clear();
+
+		if ((frame % 60) == 0)
+			SampleFragmentation(bench);
+	}
+
+	Report(bench);
+}
+
+static void RunChurn(size_t heap_size, unsigned iterations)
+{
+	// Random sizes with a steady live set, freed in random order
+	ResetHeap(heap_size);
+	Bench bench("churn");
+
+	std::vector<void*> live;
+	for (unsigned i = 0; i < iterations; i++)
+	{
+		if (live.size() < 4096 && RandRange(0, 1) == 0)
+		{
+			if (void *ptr = BenchAlloc(bench, RandLog(8, 4096)))
+				live.push_back(ptr);
+		}
+		else if (!live.empty())
+		{
+			size_t j = RandRange(0, live.size() - 1);
+			BenchFree(bench, live[j]);
+			live[j] = live.back();
+			live.pop_back();
+		}
+
+		if ((i % 1000) == 0)
+			SampleFragmentation(bench);
+	}
+
+	Report(bench);
+}
+
+static void RunRealloc(size_t heap_size, unsigned iterations)
+{
+	// Arrays growing by doubling, with small allocations landing between them
+	// 64 arrays of up to 16 KiB fit in the default heap, so failures point at fragmentation
+	ResetHeap(heap_size);
+	Bench bench("realloc");
+
+	size_t in_place0, moved0, copied0;
+	Mem::ProfileRealloc(&in_place0, &moved0, &copied0);
+
+	struct Array
+	{
+		void *ptr;
+		size_t size, cap;
+	};
+	std::vector<Array> arrays(64, Array{ nullptr, 0, 0 });
+	std::vector<void*> small;
+
+	for (unsigned i = 0; i < iterations; i++)
+	{
+		Array &array = arrays[RandRange(0, arrays.size() - 1)];
+		if (array.size >= array.cap)
+		{
+			// Array is full, grow it or start again
+			size_t size = (array.size == 0) ? 16 : (array.size * 2);
+			if (size > 16384)
+			{
+				BenchFree(bench, array.ptr);
+				array = Array{ nullptr, 0, RandLog(256, 16384) };
+				continue;
+			}
+			if (void *ptr = BenchRealloc(bench, array.ptr, size))
+			{
+				array.ptr = ptr;
+				array.size = size;
+			}
+		}
+		else
+		{
+			array.size = array.cap;
+		}
+
+		if (RandRange(0, 3) == 0)
+		{
+			if (small.size() < 1024)
+			{
+				if (void *ptr = BenchAlloc(bench, RandLog(8, 128)))
+					small.push_back(ptr);
+			}
+			else
+			{
+				size_t j = RandRange(0, small.size() - 1);
+				BenchFree(bench, small[j]);
+				small[j] = small.back();
+				small.pop_back();
+			}
+		}
+
+		if ((i % 1000) == 0)
+			SampleFragmentation(bench);
+	}
+
+	Report(bench);
+
+	size_t in_place, moved, copied;
+	Mem::ProfileRealloc(&in_place, &moved, &copied);
+	std::printf("         realloc in place %zu moved %zu copied %zu\n", in_place - in_place0, moved - moved0, copied - copied0);
+}
+
+// Trace replay
+static bool RunTrace(size_t heap_size, const char *path)
+{
+	std::ifstream trace(path);
+	if (!trace)
+	{
+		std::cerr << "Could not open trace" << std::endl;
+		return false;
+	}
+
+	ResetHeap(heap_size);
+	Bench bench("trace");
+
+	std::unordered_map<unsigned long, void*> live;
+	std::string line;
+	for (unsigned long line_number = 1; std::getline(trace, line); line_number++)
+	{
+		std::istringstream stream(line);
+		char op;
+		unsigned long id;
+		size_t size = 0, align = 0;
+		if (!(stream >> op) || op == '#')
+			continue;
+		if (!(stream >> id) || (op != 'f' && !(stream >> size)))
+		{
+			std::cerr << "Malformed trace line " << line_number << std::endl;
+			return false;
+		}
+		stream >> align;
+
+		switch (op)
+		{
+			case 'a':
+			{
+				if (void *ptr = BenchAlloc(bench, size, align))
+					live[id] = ptr;
+				break;
+			}
+			case 'r':
+			{
+				auto it = live.find(id);
+				void *ptr = BenchRealloc(bench, (it != live.end()) ? it->second : nullptr, size);
+				if (ptr != nullptr)
+					live[id] = ptr;
+				break;
+			}
+			case 'f':
+			{
+				auto it = live.find(id);
+				if (it != live.end())
+				{
+					BenchFree(bench, it->second);
+					live.erase(it);
+				}
+				break;
+			}
+			default:
+			{
+				std::cerr << "Unknown trace operation on line " << line_number << std::endl;
+				return false;
+			}
+		}
+
+		if ((line_number % 1000) == 0)
+			SampleFragmentation(bench);
+	}
+
+	Report(bench);
+	return true;
+}
+
+// Fuzzing
+static bool RunFuzz(size_t heap_size, unsigned iterations)
+{
+	// Fill every allocation with a pattern and check it survives, and that the heap's statistics add up
+	ResetHeap(heap_size);
+
+	static std::vector<uint64_t> expansion(heap_size / 4 / sizeof(uint64_t));
+	Mem::Heap *expansion_heap = Mem::CreateHeap(expansion.data(), expansion.size() * sizeof(uint64_t), "Expansion");
+	Mem::SetHeap(Mem::Tag_Asset, expansion_heap);
+
+	struct Block
+	{
+		uint8_t *ptr;
+		size_t size;
+		uint8_t fill;
+		bool asset;
+	};
+	std::vector<Block> live;
+
+	auto Fail = [](unsigned i, const char *what)
+	{
+		std::printf("fuzz: %s at iteration %u\n", what, i);
+		return false;
+	};
+	auto Check = [](const Block &block)
+	{
+		for (size_t k = 0; k < block.size; k++)
+			if (block.ptr[k] != block.fill)
+				return false;
+		return true;
+	};
+
+	size_t fails = 0;
+	for (unsigned i = 0; i < iterations; i++)
+	{
+		size_t op = RandRange(0, 9);
+		if (op < 5)
+		{
+			// Allocate
+			size_t size = (RandRange(0, 7) == 0) ? RandRange(0, 40000) : RandRange(0, 256);
+			size_t align = (RandRange(0, 3) == 0) ? (size_t(8) << RandRange(0, 5)) : 0;
+			bool asset = RandRange(0, 2) == 0;
+
+			uint8_t *ptr;
+			if (asset)
+				ptr = (uint8_t*)((align != 0) ? Mem::AllocAligned(size, align, 0, Mem::Tag_Asset) : Mem::Alloc(size, Mem::Tag_Asset));
+			else
+				ptr = (uint8_t*)((align != 0) ? Mem::AllocAligned(size, align) : Mem::Alloc(size));
+			if (ptr == nullptr)
+			{
+				fails++;
+				continue;
+			}
+
+			if ((uintptr_t(ptr) & ((align != 0) ? (align - 1) : 7)) != 0)
+				return Fail(i, "misaligned allocation");
+			bool in_expansion = (void*)ptr >= (void*)expansion.data() && (void*)ptr < (void*)(expansion.data() + expansion.size());
+			if (in_expansion != asset)
+				return Fail(i, "allocation from the wrong heap");
+
+			Block block{ ptr, size, uint8_t(RandRange(0, 255)), asset };
+			std::memset(block.ptr, block.fill, block.size);
+			live.push_back(block);
+		}
+		else if (op < 8 && !live.empty())
+		{
+			// Free
+			size_t j = RandRange(0, live.size() - 1);
+			if (!Check(live[j]))
+				return Fail(i, "corrupted block");
+			Mem::Free(live[j].ptr);
+			live[j] = live.back();
+			live.pop_back();
+		}
+		else if (!live.empty())
+		{
+			// Reallocate
+			Block &block = live[RandRange(0, live.size() - 1)];
+			size_t size = RandRange(0, 2000);
+			uint8_t *ptr = (uint8_t*)Mem::Realloc(block.ptr, size);
+			if (ptr == nullptr)
+			{
+				fails++;
+				if (!Check(block))
+					return Fail(i, "failed reallocation touched data");
+				continue;
+			}
+
+			block.ptr = ptr;
+			block.size = std::min(size, block.size);
+			if (!Check(block))
+				return Fail(i, "reallocation lost data");
+			block.size = size;
+			std::memset(block.ptr, block.fill, block.size);
+		}
+
+		if (OS::irq_depth != 0)
+			return Fail(i, "unbalanced IRQ disable");
+	}
+
+	// Check statistics, then free everything and make sure the heaps are empty again
+	for (const Block &block : live)
+		if (!Check(block))
+			return Fail(iterations, "corrupted block");
+
+	size_t used, blocks;
+	Mem::Profile(&used, nullptr, &blocks);
+	Mem::Stats stats;
+	Mem::GetStats(Mem::GetHeap(Mem::Tag_General), &stats);
+	if (stats.used != used || stats.blocks != blocks || stats.peak < stats.used || stats.largest_free > (stats.total - stats.used))
+		return Fail(iterations, "inconsistent statistics");
+
+	for (const Block &block : live)
+		Mem::Free(block.ptr);
+
+	for (Mem::Heap *heap : { Mem::GetHeap(Mem::Tag_General), expansion_heap })
+	{
+		Mem::GetStats(heap, &stats);
+		if (stats.used != 0 || stats.blocks != 0)
+			return Fail(iterations, "heap not empty after freeing everything");
+		if (stats.free_blocks != 1 || stats.largest_free != stats.total)
+			return Fail(iterations, "heap didn't coalesce after freeing everything");
+	}
+
+	std::printf("fuzz     %u operations, %zu failed allocations, no errors\n", iterations, fails);
+	return true;
+}
+
+static bool RunHandleFuzz(size_t heap_size, unsigned iterations)
+{
+	// Check that Init stays inside its buffer for sizes and handle counts that don't fit
+	auto Fail = [](unsigned i, const char *what)
+	{
+		std::printf("handle fuzz: %s at iteration %u\n", what, i);
+		return false;
+	};
+
+	static const size_t GUARD = 64;
+	static const uint8_t GUARD_FILL = 0xA5;
+	static const struct { size_t size; unsigned handles; } edges[] = {
+		{ 0, 16 }, { 3, 16 }, { 8, 0 }, { 8, 1 }, { 8, 2 }, { 64, 0 }, { 64, 1 }, { 64, 2 },
+		{ 64, 1000 }, { 4096, 0x10000 }, { 4096, 0xFFFFFFFF }, { 0x48000, 0x20000 },
+	};
+	for (const auto &edge : edges)
+	{
+		for (size_t offset = 0; offset < 8; offset++)
+		{
+			std::vector<uint8_t> buffer(GUARD + offset + edge.size + GUARD, GUARD_FILL);
+			uint8_t *data = buffer.data() + GUARD + offset;
+
+			Mem::HandleHeap heap;
+			heap.Init(data, edge.size, edge.handles);
+			if (heap.Get(0) != nullptr || heap.Size(0) != 0)
+				return Fail(0, "null handle isn't null");
+			heap.Lock(0);
+			heap.Unlock(0);
+
+			// Allocate until full, touching all of the memory
+			std::vector<Mem::Handle> handles;
+			while (Mem::Handle handle = heap.Alloc(RandRange(0, 64)))
+			{
+				std::memset(heap.Get(handle), 0x5A, heap.Size(handle));
+				handles.push_back(handle);
+			}
+			for (Mem::Handle handle : handles)
+				heap.Free(handle);
+			heap.Compact(~size_t(0));
+
+			for (size_t k = 0; k < GUARD + offset; k++)
+				if (buffer[k] != GUARD_FILL)
+					return Fail(0, "write before the buffer");
+			for (size_t k = GUARD + offset + edge.size; k < buffer.size(); k++)
+				if (buffer[k] != GUARD_FILL)
+					return Fail(0, "write past the buffer");
+		}
+	}
+
+	// Random allocations, frees, locks and compaction, checking data survives being moved
+	std::vector<uint64_t> buffer(heap_size / 8 / sizeof(uint64_t));
+	Mem::HandleHeap heap;
+	heap.Init(buffer.data(), buffer.size() * sizeof(uint64_t), 1024);
+
+	struct Block
+	{
+		Mem::Handle handle;
+		size_t size;
+		uint8_t fill;
+		unsigned lock;
+		void *locked;
+	};
+	std::vector<Block> live;
+
+	auto Check = [&heap](const Block &block)
+	{
+		const uint8_t *ptr = heap.Get<uint8_t>(block.handle);
+		for (size_t k = 0; k < block.size; k++)
+			if (ptr[k] != block.fill)
+				return false;
+		return true;
+	};
+
+	size_t fails = 0;
+	for (unsigned i = 0; i < iterations; i++)
+	{
+		size_t op = RandRange(0, 9);
+		if (op < 4)
+		{
+			// Allocate
+			size_t size = (RandRange(0, 7) == 0) ? RandRange(0, 8000) : RandRange(0, 256);
+			Mem::Handle handle = heap.Alloc(size);
+			if (handle == 0)
+			{
+				fails++;
+				continue;
+			}
+			if ((uintptr_t(heap.Get(handle)) & 7) != 0)
+				return Fail(i, "misaligned allocation");
+			if (heap.Size(handle) < size)
+				return Fail(i, "allocation too small");
+
+			Block block{ handle, size, uint8_t(RandRange(0, 255)), 0, nullptr };
+			std::memset(heap.Get(handle), block.fill, block.size);
+			live.push_back(block);
+		}
+		else if (op < 7 && !live.empty())
+		{
+			// Free
+			size_t j = RandRange(0, live.size() - 1);
+			if (!Check(live[j]))
+				return Fail(i, "corrupted block");
+			while (live[j].lock != 0)
+			{
+				heap.Unlock(live[j].handle);
+				live[j].lock--;
+			}
+			heap.Free(live[j].handle);
+			live[j] = live.back();
+			live.pop_back();
+		}
+		else if (op < 8 && !live.empty())
+		{
+			// Lock or unlock
+			Block &block = live[RandRange(0, live.size() - 1)];
+			if (block.lock != 0 && RandRange(0, 1) == 0)
+			{
+				heap.Unlock(block.handle);
+				block.lock--;
+			}
+			else
+			{
+				heap.Lock(block.handle);
+				if (block.lock++ == 0)
+					block.locked = heap.Get(block.handle);
+			}
+		}
+		else
+		{
+			// Compact
+			heap.Compact(RandRange(0, 4096));
+			for (const Block &block : live)
+				if (block.lock != 0 && heap.Get(block.handle) != block.locked)
+					return Fail(i, "locked block moved");
+		}
+	}
+
+	for (const Block &block : live)
+		if (!Check(block))
+			return Fail(iterations, "corrupted block");
+
+	// Free everything, then compaction should gather all of the memory at the end of the heap
+	for (const Block &block : live)
+	{
+		for (unsigned k = 0; k < block.lock; k++)
+			heap.Unlock(block.handle);
+		heap.Free(block.handle);
+	}
+	heap.Compact(~size_t(0));
+
+	size_t used, total, contiguous;
+	heap.Profile(&used, &total, &contiguous);
+	if (used != 0 || contiguous != total)
+		return Fail(iterations, "heap not empty after freeing everything");
+
+	std::printf("handles  %u operations, %zu failed allocations, no errors\n", iterations, fails);
+	return true;
+}
+
+// Entry point
+int main(int argc, char *argv[])
+{
+	// Parse options
+	size_t heap_size = 1792 * 1024;
+	unsigned seed = 1;
+	unsigned frames = 36000;
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-'; argi++)
+	{
+		if (argi + 1 >= argc)
+			break;
+		if (std::strcmp(argv[argi], "-heap") == 0)
+			heap_size = std::strtoul(argv[++argi], nullptr, 0) * 1024;
+		else if (std::strcmp(argv[argi], "-seed") == 0)
+			seed = std::strtoul(argv[++argi], nullptr, 0);
+		else if (std::strcmp(argv[argi], "-frames") == 0)
+			frames = std::strtoul(argv[++argi], nullptr, 0);
+		else
+			break;
+	}
+
+	if (argi >= argc)
+	{
+		std::cout << "usage: MemBench [-heap KiB] [-seed n] [-frames n] game|churn|realloc|trace file|fuzz [n]|all" << std::endl;
+		return 0;
+	}
+	std::string mode = argv[argi++];
+
+	rng.seed(seed);
+	CalibrateTimer();
+
+	#ifdef CKSDK_MEM_FIRSTFIT
+	std::printf("first-fit heap, %zu KiB, seed %u\n", heap_size / 1024, seed);
+	#else
+	std::printf("TLSF heap, %zu KiB, seed %u\n", heap_size / 1024, seed);
+	#endif
+
+	// Run mode
+	unsigned iterations = (argi < argc) ? std::strtoul(argv[argi], nullptr, 0) : 1000000;
+	if (mode == "game")
+	{
+		RunGame(heap_size, frames);
+	}
+	else if (mode == "churn")
+	{
+		RunChurn(heap_size, iterations);
+	}
+	else if (mode == "realloc")
+	{
+		RunRealloc(heap_size, iterations);
+	}
+	else if (mode == "trace")
+	{
+		if (argi >= argc)
+		{
+			std::cerr << "No trace given" << std::endl;
+			return 1;
+		}
+		if (!RunTrace(heap_size, argv[argi]))
+			return 1;
+	}
+	else if (mode == "fuzz")
+	{
+		if (!RunFuzz(heap_size, iterations) || !RunHandleFuzz(heap_size, iterations))
+			return 1;
+	}
+	else if (mode == "all")
+	{
+		RunGame(heap_size, frames);
+		RunChurn(heap_size, 1000000);
+		RunRealloc(heap_size, 1000000);
+		if (!RunFuzz(heap_size, 1000000) || !RunHandleFuzz(heap_size, 1000000))
+			return 1;
+	}
+	else
+	{
+		std::cerr << "Unknown mode " << mode << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
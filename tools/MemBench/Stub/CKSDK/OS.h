@@ -0,0 +1,38 @@
+/*
+	[ CKSDK ]
+	Copyright 2023 Regan "CKDEV" Green
+
+	Permission to use, copy, modify, and/or distribute this software for any
+	purpose with or without fee is hereby granted, provided that the above
+	copyright notice and this permission notice appear in all copies.
+
+	THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+	WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+	ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+	WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+	ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+	OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+// Host stub of CKSDK/OS.h for MemBench
+
+#pragma once
+
+#include <CKSDK/CKSDK.h>
+
+namespace CKSDK
+{
+	namespace OS
+	{
+		// Scratchpad
+		static constexpr uintptr_t ScratchpadBase = 0x1F800000;
+		static constexpr size_t ScratchpadSize = 0x400;
+
+		// IRQ nesting depth, checked by MemBench to catch unbalanced Disable/EnableIRQ calls
+		inline int irq_depth = 0;
+
+		inline void DisableIRQ() { irq_depth++; }
+		inline void EnableIRQ() { irq_depth--; }
+	}
+}
@@ -150,7 +150,8 @@ int main(int argc, char *argv[])
 		// Get program address range
 		for (auto &i : phdrs)
 		{
-			if (i.p_flags == PF_R)
+			// Skip segments with nothing to load (i.e. the scratchpad)
+			if (i.p_flags == PF_R || i.p_filesz == 0)
 				continue;
 			if (i.p_vaddr < min_addr)
 				min_addr = i.p_vaddr;
@@ -190,7 +191,7 @@ int main(int argc, char *argv[])
 		buffer.resize(max_addr - min_addr);
 		for (auto &i : phdrs)
 		{
-			if (i.p_flags == PF_R)
+			if (i.p_flags == PF_R || i.p_filesz == 0)
 				continue;
 			elf.seekg(i.p_offset);
 			if (i.p_vaddr < min_addr || (i.p_vaddr - min_addr) + i.p_filesz > buffer.size())